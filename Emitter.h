@@ -5,16 +5,49 @@
 
 #define MAX_EMITTERS 1024
 
+// What the emitter pass does with spawns that find the dead list empty
+#define OVERFLOW_DROP		0	// drop the spawn and count it
+#define OVERFLOW_RECYCLE	1	// overwrite the live particles with the most of their life used, see ParticleRecycle.h
+#define OVERFLOW_STEAL		2	// overwrite particles of lower-priority emitters, see ParticleRecycle.h
+
+// Slots of the per-pool stats counter buffer
+#define PARTICLE_STAT_DROPPED	0
+#define PARTICLE_STAT_RECYCLED	1
+#define PARTICLE_STAT_STOLEN	2
+#define PARTICLE_STAT_COUNT		3
+
 CBUFFER Emitter REGISTER(b0)
 {
 	float4		position;	// w = 0.0 (initial age)
-	float4		velocity;	// w = life time
+	float4		velocity;	// w unused, the life time is in EmitterParams
 	uint		emitCount;
 	uint		deadParticles;
 	float		emitRate;	// particles per second
 	float		counter;	//
 	float		totalTime;	// total time elapsed since the start. Need for noise generation
-	uint3		_padding;
+	int			priority;	// under OVERFLOW_STEAL, who may overwrite whose particles (CPU only)
+	uint		ringBase;	// first slot of this emitter's ring
+	uint		ringSize;	// 0 = allocate from the dead list
+	uint		ringHead;	// next slot to spawn into, relative to ringBase
+	uint		emitterIndex;	// this emitter's entry in the pool's EmitterParams
+	float		prewarmAge;		// > 0: this frame's spawns are a prewarm, aged evenly over [0, prewarmAge)
+	float		prewarmPending;	// prewarm to run on the next update (CPU only)
 };
 
+// One entry per emitting emitter of a fused pool, uploaded every frame
+struct EmitterSpawn
+{
+	float4		position;
+	float4		velocity;
+	uint		firstTicket;	// this emitter's spawns are tickets [firstTicket, firstTicket + emitCount)
+	uint		emitCount;
+	uint		emitterIndex;
+	float		prewarmAge;
+};
+
+// Per-dispatch counters of the fused pass
+#define FUSED_COUNTER_TICKETS		0	// dead slots handed out so far
+#define FUSED_COUNTER_GROUPS_DONE	1	// thread groups that finished the pass
+#define FUSED_COUNTER_COUNT			2
+
 #endif
\ No newline at end of file
@@ -0,0 +1,23 @@
+#ifndef _EMITTER_PARAMS_
+#define _EMITTER_PARAMS_
+
+#include "ShaderCommon.h"
+
+// EmitterParams::flags
+#define EMITTER_FLAG_LOCAL_SPACE	1	// particles live in the emitter's transform, applied at draw time
+
+// Per-emitter settings read by the particles every frame, one entry per
+// emitter of the pool. Uploaded only when an emitter changes them
+struct EmitterParams
+{
+	float3		gravity;	// acceleration
+	float		lifeTime;
+	float4		color;		// multiplies the texture
+	float4		uvRect;		// texture frame: xy offset, zw scale
+	float		drag;		// fraction of the speed lost per second
+	float		size;		// world size of the quad at birth
+	uint		flags;		// EMITTER_FLAG_*
+	float		sizeEnd;	// and at the end of its life
+};
+
+#endif
\ No newline at end of file
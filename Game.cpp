@@ -3,6 +3,8 @@
 #include "Particle.h"
 
 #include "FrameCapture.h"
+#include "HostBenchmark.h"
+#include "ParticleBake.h"
 
 #include <WICTextureLoader.h>
 
@@ -439,9 +441,62 @@ void Game::InitParticles()
 		10.0f
 	);
 
+	// -bake starts a worker per shard and waits for them, -bakeShard is
+	// one of those workers; either way the process exits when done
+	ParticleBakeDesc bake;
+	ParticleBakeShard shard;
+	if (ParticleBake::ParseCoordinator(GetCommandLineW(), bake))
+		PostQuitMessage(ParticleBake::Run(bake) ? 0 : 1);
+	else if (ParticleBake::ParseWorker(GetCommandLineW(), shard))
+		PostQuitMessage(ParticleBake::RunWorker(particleSystem, L"Assets/Textures/smoke.png", shard) ? 0 : 1);
+	else if (nullptr != wcsstr(GetCommandLineW(), L"-benchmarkHost"))
+		BenchmarkHost();
+
 	frameCount = 0;
 }
 
+// Prints how fast host-side particle work runs: updates with their memory
+// on the thread's own NUMA node, interleaved, or on another node, grid
+// binning before and after a Morton sort, each CPU batch size, whose
+// winner goes to the tuner cache, and the specialized CPU simulate steps
+// against the all-features one. Then exits
+void Game::BenchmarkHost()
+{
+	ParticleModuleGraph graph;
+	graph.Add(PARTICLE_STAGE_UPDATE, PARTICLE_MODULE_ADD_FORCE, XMFLOAT4(0.0f, -9.8f, 0.0f, 0.0f));
+	graph.Add(PARTICLE_STAGE_UPDATE, PARTICLE_MODULE_DRAG, XMFLOAT4(0.5f, 0.0f, 0.0f, 0.0f));
+
+	ParticleProgram program;
+	graph.Compile(program);
+
+	HostPlacementTimings timings = BenchmarkHostPlacement(program, 1 << 22, 20);
+	printf("\n%u NUMA nodes, 4M particles per node: node-local %.2f ms, interleaved %.2f ms, remote %.2f ms per pass\n",
+		HostNodeCount(), timings.nodeLocal, timings.interleaved, timings.remote);
+
+	HostReorderTimings reorder = BenchmarkHostReorder(1 << 22, 256, 20);
+	printf("4M particles binned into 256^3 cells: %.2f ms scattered, %.2f ms Morton-sorted per pass, %.2f ms to sort\n",
+		reorder.scattered, reorder.sorted, reorder.sort);
+
+	HostBatchTimings batch = BenchmarkHostBatch(program, 1 << 22, 20, L"ParticleHost.cache");
+	printf("4M particles updated in batches of %u: %.2f ms, of %u: %.2f ms per pass; tuned to %d\n",
+		MODULE_BATCH_SIZES[0], batch.variants[0], MODULE_BATCH_SIZES[1], batch.variants[1],
+		batch.winner >= 0 ? (int)MODULE_BATCH_SIZES[batch.winner] : -1);
+
+	// next to ParticlePoolTimings::allFeatures on the GPU
+	HostFeatureTimings features = BenchmarkHostFeatures(program, 1 << 22, 20);
+	for (uint32_t mask = 0; mask < HOST_FEATURE_MASKS; ++mask)
+	{
+		printf("4M particles simulated with%s%s%s%s: %.2f ms specialized, %.2f ms all features per step\n",
+			(mask & HOST_FEATURE_MODULES) ? " modules" : "",
+			(mask & HOST_FEATURE_FORCES) ? " forces" : "",
+			(mask & HOST_FEATURE_COLLIDE) ? " collide" : "",
+			(mask & HOST_FEATURE_EVENTS) ? " events" : (mask ? "" : " nothing"),
+			features.specialized[mask], features.allFeatures[mask]);
+	}
+
+	PostQuitMessage(0);
+}
+
 void Game::UpdateParticles(float deltaTime, float totalTime)
 {
 	particleSystem.Update(deltaTime, totalTime);
@@ -40,6 +40,7 @@ private:
 	void CreateEntities();
 	void InitLights(); 
 	void InitParticles();
+	void BenchmarkHost();
 
 	void UpdateParticles(float deltaTime, float totalTime);
 
@@ -0,0 +1,142 @@
+#include "GpuTimer.h"
+
+#include <cassert>
+
+GpuTimer::GpuTimer()
+	:
+	context(nullptr),
+	frameIdx(0),
+	recording(false),
+	open(nullptr)
+{
+	for (unsigned int f = 0; f < FRAMES_IN_FLIGHT; ++f)
+	{
+		frames[f].disjoint = nullptr;
+		for (unsigned int t = 0; t < TIMINGS_PER_FRAME; ++t)
+		{
+			frames[f].timings[t].begin = nullptr;
+			frames[f].timings[t].end = nullptr;
+		}
+		frames[f].timingCount = 0;
+		frames[f].pending = false;
+	}
+}
+
+void GpuTimer::Init(ID3D11Device* device, ID3D11DeviceContext* context)
+{
+	HRESULT hr = S_OK;
+
+	this->context = context;
+
+	D3D11_QUERY_DESC disjointDesc = { D3D11_QUERY_TIMESTAMP_DISJOINT, 0 };
+	D3D11_QUERY_DESC timestampDesc = { D3D11_QUERY_TIMESTAMP, 0 };
+
+	for (unsigned int f = 0; f < FRAMES_IN_FLIGHT; ++f)
+	{
+		Frame& frame = frames[f];
+
+		hr = device->CreateQuery(&disjointDesc, &frame.disjoint);
+		assert(hr == S_OK);
+
+		for (unsigned int t = 0; t < TIMINGS_PER_FRAME; ++t)
+		{
+			hr = device->CreateQuery(&timestampDesc, &frame.timings[t].begin);
+			assert(hr == S_OK);
+
+			hr = device->CreateQuery(&timestampDesc, &frame.timings[t].end);
+			assert(hr == S_OK);
+		}
+
+		frame.timingCount = 0;
+		frame.pending = false;
+	}
+}
+
+void GpuTimer::CleanUp()
+{
+	for (unsigned int f = 0; f < FRAMES_IN_FLIGHT; ++f)
+	{
+		Frame& frame = frames[f];
+
+		if (frame.disjoint) frame.disjoint->Release();
+		for (unsigned int t = 0; t < TIMINGS_PER_FRAME; ++t)
+		{
+			if (frame.timings[t].begin) frame.timings[t].begin->Release();
+			if (frame.timings[t].end) frame.timings[t].end->Release();
+		}
+	}
+}
+
+void GpuTimer::BeginFrame(std::vector<GpuTiming>& landed)
+{
+	Frame& frame = frames[frameIdx];
+
+	if (frame.pending)
+		Resolve(frame, landed);
+
+	recording = !frame.pending;
+	if (!recording)
+		return;
+
+	frame.timingCount = 0;
+	context->Begin(frame.disjoint);
+}
+
+void GpuTimer::EndFrame()
+{
+	if (recording)
+	{
+		Frame& frame = frames[frameIdx];
+		context->End(frame.disjoint);
+		frame.pending = true;
+		recording = false;
+	}
+
+	frameIdx = (frameIdx + 1) % FRAMES_IN_FLIGHT;
+}
+
+void GpuTimer::Begin(unsigned int tag)
+{
+	Frame& frame = frames[frameIdx];
+	if (!recording || frame.timingCount == TIMINGS_PER_FRAME)
+		return;
+
+	open = &frame.timings[frame.timingCount++];
+	open->tag = tag;
+	context->End(open->begin);
+}
+
+void GpuTimer::End()
+{
+	if (nullptr == open)
+		return;
+
+	context->End(open->end);
+	open = nullptr;
+}
+
+void GpuTimer::Resolve(Frame& frame, std::vector<GpuTiming>& landed)
+{
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint = {};
+	if (S_OK != context->GetData(frame.disjoint, &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH))
+		return;
+
+	// the disjoint query lands last, so every timestamp in the frame has too
+	frame.pending = false;
+	if (disjoint.Disjoint)
+		return;
+
+	for (unsigned int t = 0; t < frame.timingCount; ++t)
+	{
+		const Timing& timing = frame.timings[t];
+
+		UINT64 begin = 0;
+		UINT64 end = 0;
+		if (S_OK != context->GetData(timing.begin, &begin, sizeof(begin), 0) ||
+			S_OK != context->GetData(timing.end, &end, sizeof(end), 0))
+			continue;
+
+		GpuTiming result = { timing.tag, (double)(end - begin) / disjoint.Frequency };
+		landed.push_back(result);
+	}
+}
\ No newline at end of file
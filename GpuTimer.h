@@ -0,0 +1,64 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <vector>
+
+// A stretch of GPU work timed by GpuTimer, under the tag it was begun with
+struct GpuTiming
+{
+	unsigned int					tag;
+	double							seconds;
+};
+
+// Times GPU work with timestamp queries, for the profiler and KernelTuner.
+// It never waits on the GPU: timings land a few frames late, and a frame
+// whose queries are still in flight when its slot comes round again is not
+// timed at all
+class GpuTimer
+{
+public:
+	GpuTimer();
+
+	void Init(ID3D11Device* device, ID3D11DeviceContext* context);
+
+	void CleanUp();
+
+	// Bracket everything timed in a frame. BeginFrame appends the timings
+	// that landed since the last call to `landed`
+	void BeginFrame(std::vector<GpuTiming>& landed);
+	void EndFrame();
+
+	// Every Begin must be followed by End once the work is issued. Work
+	// past TIMINGS_PER_FRAME in a frame goes untimed
+	void Begin(unsigned int tag);
+	void End();
+
+private:
+	static const unsigned int FRAMES_IN_FLIGHT = 4;
+	static const unsigned int TIMINGS_PER_FRAME = 64;
+
+	struct Timing
+	{
+		ID3D11Query*				begin;
+		ID3D11Query*				end;
+		unsigned int				tag;
+	};
+
+	struct Frame
+	{
+		ID3D11Query*				disjoint;
+		Timing						timings[TIMINGS_PER_FRAME];
+		unsigned int				timingCount;
+		bool						pending;
+	};
+
+	void Resolve(Frame& frame, std::vector<GpuTiming>& landed);
+
+	ID3D11DeviceContext*			context;
+
+	Frame							frames[FRAMES_IN_FLIGHT];
+	unsigned int					frameIdx;
+	bool							recording;
+	Timing*							open;
+};
\ No newline at end of file
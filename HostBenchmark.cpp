@@ -0,0 +1,252 @@
+#include "HostBenchmark.h"
+
+#include "HostMemory.h"
+#include "HostReorder.h"
+#include "KernelTuner.h"
+
+#include <windows.h>
+
+#include <thread>
+#include <vector>
+
+namespace
+{
+	typedef std::vector<Particle, HostAllocator<Particle>> ParticleArray;
+
+	enum Placement
+	{
+		PLACE_LOCAL,
+		PLACE_INTERLEAVED,
+		PLACE_REMOTE
+	};
+
+	uint32_t NodeFor(Placement placement, uint32_t node, uint32_t nodeCount)
+	{
+		switch (placement)
+		{
+		case PLACE_INTERLEAVED:	return HOST_NODE_INTERLEAVED;
+		case PLACE_REMOTE:		return (node + 1) % nodeCount;
+		default:				return node;
+		}
+	}
+
+	// milliseconds per pass of the slowest thread
+	double TimePlacement(Placement placement, const ParticleProgram& program, uint32_t particleCount, uint32_t passes)
+	{
+		uint32_t nodeCount = HostNodeCount();
+		std::vector<double> seconds(nodeCount, 0.0);
+		std::vector<std::thread> threads;
+
+		for (uint32_t node = 0; node < nodeCount; ++node)
+		{
+			threads.push_back(std::thread([&, node]
+			{
+				if (!HostPinThread(node))
+					return;
+
+				EmitterParams emitter = {};
+				emitter.lifeTime = 1e6f;
+
+				// pages land where they are first touched, which is here
+				ParticleArray particles(particleCount, Particle(), HostAllocator<Particle>(NodeFor(placement, node, nodeCount)));
+				for (uint32_t i = 0; i < particleCount; ++i)
+				{
+					particles[i].position = DirectX::XMFLOAT3((float)(i % 1024), (float)(i / 1024 % 1024), 0);
+					particles[i].velocity = DirectX::XMFLOAT3(0, 1, 0);
+					particles[i].emitter = 0;
+				}
+
+				LARGE_INTEGER frequency, start, end;
+				QueryPerformanceFrequency(&frequency);
+				QueryPerformanceCounter(&start);
+
+				for (uint32_t pass = 0; pass < passes; ++pass)
+					ParticleModuleGraph::Run(program, PARTICLE_STAGE_UPDATE, particles.data(), particleCount, &emitter, 1.0f / 60, pass / 60.0f);
+
+				QueryPerformanceCounter(&end);
+				seconds[node] = (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+			}));
+		}
+
+		double slowest = 0.0;
+		for (uint32_t node = 0; node < nodeCount; ++node)
+		{
+			threads[node].join();
+			slowest = max(slowest, seconds[node]);
+		}
+
+		return passes > 0 ? slowest * 1000.0 / passes : 0.0;
+	}
+
+	double Seconds(const LARGE_INTEGER& start, const LARGE_INTEGER& end)
+	{
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		return (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+	}
+
+	// milliseconds per pass of counting the particles into their cells
+	double TimeBinning(const ParticleArray& particles, std::vector<uint32_t>& grid, uint32_t gridSize, uint32_t passes)
+	{
+		LARGE_INTEGER start, end;
+		QueryPerformanceCounter(&start);
+
+		for (uint32_t pass = 0; pass < passes; ++pass)
+		{
+			for (auto iter = particles.begin(); iter != particles.end(); ++iter)
+			{
+				uint32_t x = min((uint32_t)iter->position.x, gridSize - 1);
+				uint32_t y = min((uint32_t)iter->position.y, gridSize - 1);
+				uint32_t z = min((uint32_t)iter->position.z, gridSize - 1);
+				grid[(z * gridSize + y) * gridSize + x]++;
+			}
+		}
+
+		QueryPerformanceCounter(&end);
+		return passes > 0 ? Seconds(start, end) * 1000.0 / passes : 0.0;
+	}
+}
+
+HostPlacementTimings BenchmarkHostPlacement(const ParticleProgram & program, uint32_t particleCount, uint32_t passes)
+{
+	HostPlacementTimings timings = {};
+	timings.nodeLocal = TimePlacement(PLACE_LOCAL, program, particleCount, passes);
+	timings.interleaved = TimePlacement(PLACE_INTERLEAVED, program, particleCount, passes);
+	timings.remote = TimePlacement(PLACE_REMOTE, program, particleCount, passes);
+	return timings;
+}
+
+
+HostReorderTimings BenchmarkHostReorder(uint32_t particleCount, uint32_t gridSize, uint32_t passes)
+{
+	// xorshift, the same scatter on every run
+	uint32_t random = 1;
+	auto coordinate = [&random, gridSize]
+	{
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		return (float)(random >> 8) / (1 << 24) * gridSize;
+	};
+
+	ParticleArray particles(particleCount);
+	for (auto iter = particles.begin(); iter != particles.end(); ++iter)
+	{
+		iter->position = DirectX::XMFLOAT3(coordinate(), coordinate(), coordinate());
+		iter->velocity = DirectX::XMFLOAT3(0, 0, 0);
+		iter->emitter = 0;
+	}
+
+	std::vector<uint32_t> grid((size_t)gridSize * gridSize * gridSize, 0);
+
+	HostReorderTimings timings = {};
+	timings.scattered = TimeBinning(particles, grid, gridSize, passes);
+
+	// one grid cell per Morton cell
+	LARGE_INTEGER start, end;
+	QueryPerformanceCounter(&start);
+	HostMortonSort(particles.data(), particleCount, 1.0f);
+	QueryPerformanceCounter(&end);
+	timings.sort = Seconds(start, end) * 1000.0;
+
+	timings.sorted = TimeBinning(particles, grid, gridSize, passes);
+	return timings;
+}
+
+HostBatchTimings BenchmarkHostBatch(const ParticleProgram & program, uint32_t particleCount, uint32_t passes, const std::wstring & cacheFile)
+{
+	KernelTuner tuner;
+	tuner.Init(nullptr, nullptr, cacheFile);
+
+	EmitterParams emitter = {};
+	emitter.lifeTime = 1e6f;
+
+	ParticleArray particles(particleCount);
+	for (uint32_t i = 0; i < particleCount; ++i)
+	{
+		particles[i].position = DirectX::XMFLOAT3((float)(i % 1024), (float)(i / 1024 % 1024), 0);
+		particles[i].velocity = DirectX::XMFLOAT3(0, 1, 0);
+		particles[i].emitter = 0;
+	}
+
+	// variants take turns, so drift over the run hits them all alike
+	HostBatchTimings timings = {};
+	for (uint32_t pass = 0; pass < passes; ++pass)
+	{
+		for (uint32_t v = 0; v < MODULE_BATCH_VARIANT_COUNT; ++v)
+		{
+			LARGE_INTEGER start, end;
+			QueryPerformanceCounter(&start);
+			ParticleModuleGraph::Run(program, PARTICLE_STAGE_UPDATE, particles.data(), particleCount, &emitter, 1.0f / 60, pass / 60.0f, nullptr, v);
+			QueryPerformanceCounter(&end);
+
+			double seconds = Seconds(start, end);
+			timings.variants[v] += passes > 0 ? seconds * 1000.0 / passes : 0.0;
+			tuner.Report(TUNED_KERNEL_HOST_MODULES, particleCount, v, seconds);
+		}
+	}
+
+	timings.winner = tuner.GetWinner(TUNED_KERNEL_HOST_MODULES, particleCount);
+	tuner.CleanUp();
+	return timings;
+}
+
+HostFeatureTimings BenchmarkHostFeatures(const ParticleProgram & program, uint32_t particleCount, uint32_t passes)
+{
+	ParticleArray initial(particleCount);
+	for (uint32_t i = 0; i < particleCount; ++i)
+	{
+		initial[i].position = DirectX::XMFLOAT3((float)(i % 1024), (float)(i / 1024 % 1024), 0);
+		initial[i].velocity = DirectX::XMFLOAT3(0, -1, 0);
+		initial[i].emitter = 0;
+	}
+
+	ParticleProgram empty = {};
+	std::vector<ParticleEvent> events(1024);
+	uint32_t eventCount = 0;
+
+	HostFeatureTimings timings = {};
+	for (uint32_t mask = 0; mask < HOST_FEATURE_MASKS; ++mask)
+	{
+		EmitterParams emitter = {};
+		emitter.lifeTime = 1e6f;
+		if (mask & HOST_FEATURE_FORCES)
+		{
+			emitter.gravity = DirectX::XMFLOAT3(0, -9.8f, 0);
+			emitter.drag = 0.5f;
+		}
+
+		HostSimulateParams params = {};
+		params.deltaTime = 1.0f / 60;
+		params.emitterParams = &emitter;
+		params.program = (mask & HOST_FEATURE_MODULES) ? &program : &empty;
+		params.collidePlane = DirectX::XMFLOAT4(0, 1, 0, (mask & HOST_FEATURE_COLLIDE) ? 0.0f : -1e30f);
+		params.restitution = 0.5f;
+		params.events = events.data();
+		params.eventMask = (mask & HOST_FEATURE_EVENTS) ? PARTICLE_EVENT_MASK_ALL : 0;
+		params.eventCapacity = (uint32_t)events.size();
+		params.eventCount = &eventCount;
+
+		// the first run is the specialized one, the second the uber one
+		for (uint32_t run = 0; run < 2; ++run)
+		{
+			uint32_t features = run == 0 ? mask : HOST_FEATURE_MASKS - 1;
+			ParticleArray particles(initial);
+
+			LARGE_INTEGER start, end;
+			QueryPerformanceCounter(&start);
+			for (uint32_t pass = 0; pass < passes; ++pass)
+			{
+				params.totalTime = pass / 60.0f;
+				eventCount = 0;
+				HostSimulate(features, particles.data(), particleCount, params);
+			}
+			QueryPerformanceCounter(&end);
+
+			double ms = passes > 0 ? Seconds(start, end) * 1000.0 / passes : 0.0;
+			(run == 0 ? timings.specialized : timings.allFeatures)[mask] = ms;
+		}
+	}
+
+	return timings;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "HostSimulate.h"
+#include "ParticleModuleGraph.h"
+
+// Milliseconds per pass of the slowest node, see BenchmarkHostPlacement
+struct HostPlacementTimings
+{
+	double							nodeLocal;		// every thread's particles on its own node
+	double							interleaved;	// striped over all nodes, HOST_NODE_INTERLEAVED
+	double							remote;			// all on the next node over; nodeLocal again with one node
+};
+
+// Times CPU-side particle processing under each placement of its memory.
+// One thread per NUMA node, pinned to it, allocates particleCount
+// particles and runs the update stage of `program` over them `passes`
+// times, with ParticleModuleGraph::Run
+HostPlacementTimings BenchmarkHostPlacement(const ParticleProgram& program, uint32_t particleCount, uint32_t passes);
+
+// Milliseconds, see BenchmarkHostReorder
+struct HostReorderTimings
+{
+	double							scattered;		// per binning pass over particles in random slot order
+	double							sorted;			// per pass after HostMortonSort
+	double							sort;			// the sort itself
+};
+
+// Times what a Morton sort saves a pass with spatial lookups. particleCount
+// particles are spread over a gridSize^3 grid of counters in random order,
+// then each pass adds every particle to its cell, first as they are and
+// then sorted
+HostReorderTimings BenchmarkHostReorder(uint32_t particleCount, uint32_t gridSize, uint32_t passes);
+
+
+// Milliseconds per pass with each of MODULE_BATCH_SIZES, see BenchmarkHostBatch
+struct HostBatchTimings
+{
+	double							variants[MODULE_BATCH_VARIANT_COUNT];
+	int								winner;			// -1 if too few passes to decide
+};
+
+// Times the update stage of `program` over particleCount particles with
+// each CPU batch size in turn, and lets a KernelTuner pick the fastest as
+// TUNED_KERNEL_HOST_MODULES and save it to cacheFile. A winner already in
+// the cache stays
+HostBatchTimings BenchmarkHostBatch(const ParticleProgram& program, uint32_t particleCount, uint32_t passes, const std::wstring& cacheFile);
+
+// Milliseconds per step, see BenchmarkHostFeatures
+struct HostFeatureTimings
+{
+	double							specialized[HOST_FEATURE_MASKS];	// HostSimulate<mask>
+	double							allFeatures[HOST_FEATURE_MASKS];	// every feature compiled in, the unused ones fed no-op data
+};
+
+// Times HostSimulate over particleCount particles for every feature mask,
+// against the all-features instantiation doing the same work: zero forces,
+// an empty module program, a plane nothing reaches and an empty event mask
+// stand in for the features the mask leaves out
+HostFeatureTimings BenchmarkHostFeatures(const ParticleProgram& program, uint32_t particleCount, uint32_t passes);
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include "HostMemory.h"
+
+#include <windows.h>
+
+#include <new>
+
+// MEM_LARGE_PAGES fails unless the process enables SeLockMemoryPrivilege,
+// which the account has to have been granted
+static bool EnableLargePages()
+{
+	HANDLE token = nullptr;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+		return false;
+
+	TOKEN_PRIVILEGES privileges = {};
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+	// succeeds with ERROR_NOT_ALL_ASSIGNED if the account doesn't hold it
+	bool enabled = LookupPrivilegeValueW(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid)
+		&& AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr)
+		&& ERROR_SUCCESS == GetLastError();
+
+	CloseHandle(token);
+	return enabled;
+}
+
+// one reservation, committed stripe by stripe on alternating nodes
+static void* AllocInterleaved(size_t bytes)
+{
+	void* base = VirtualAlloc(nullptr, bytes, MEM_RESERVE, PAGE_READWRITE);
+	if (nullptr == base)
+		throw std::bad_alloc();
+
+	uint32_t nodeCount = HostNodeCount();
+	for (size_t offset = 0; offset < bytes; offset += HOST_PAGE_ALLOC_MIN)
+	{
+		SIZE_T stripe = min(bytes - offset, (size_t)HOST_PAGE_ALLOC_MIN);
+		DWORD node = (DWORD)(offset / HOST_PAGE_ALLOC_MIN % nodeCount);
+		if (nullptr == VirtualAllocExNuma(GetCurrentProcess(), (char*)base + offset, stripe, MEM_COMMIT, PAGE_READWRITE, node))
+		{
+			VirtualFree(base, 0, MEM_RELEASE);
+			throw std::bad_alloc();
+		}
+	}
+
+	return base;
+}
+
+void* HostAlloc(size_t bytes, uint32_t node)
+{
+	if (bytes < HOST_PAGE_ALLOC_MIN)
+		return ::operator new(bytes);
+
+	if (node == HOST_NODE_INTERLEAVED)
+		return AllocInterleaved(bytes);
+
+	if (node == HOST_NODE_ANY)
+		node = HostCurrentNode();
+
+	// large pages also need enough contiguous free memory, so they are
+	// only ever a first try
+	static const SIZE_T largePage = EnableLargePages() ? GetLargePageMinimum() : 0;
+	if (largePage > 0 && bytes >= largePage)
+	{
+		SIZE_T rounded = (bytes + largePage - 1) / largePage * largePage;
+		void* ptr = VirtualAllocExNuma(GetCurrentProcess(), nullptr, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE, node);
+		if (nullptr != ptr)
+			return ptr;
+	}
+
+	void* ptr = VirtualAllocExNuma(GetCurrentProcess(), nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, node);
+	if (nullptr == ptr)
+		throw std::bad_alloc();
+
+	return ptr;
+}
+
+void HostFree(void* ptr, size_t bytes)
+{
+	if (nullptr == ptr)
+		return;
+
+	if (bytes < HOST_PAGE_ALLOC_MIN)
+		::operator delete(ptr);
+	else
+		VirtualFree(ptr, 0, MEM_RELEASE);
+}
+
+uint32_t HostCurrentNode()
+{
+	PROCESSOR_NUMBER processor = {};
+	GetCurrentProcessorNumberEx(&processor);
+
+	USHORT node = 0;
+	if (!GetNumaProcessorNodeEx(&processor, &node))
+		return 0;
+
+	return node;
+}
+
+uint32_t HostNodeCount()
+{
+	ULONG highest = 0;
+	if (!GetNumaHighestNodeNumber(&highest))
+		return 1;
+
+	return highest + 1;
+}
+
+bool HostPinThread(uint32_t node)
+{
+	GROUP_AFFINITY affinity = {};
+	if (!GetNumaNodeProcessorMaskEx((USHORT)node, &affinity) || 0 == affinity.Mask)
+		return false;
+
+	return 0 != SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr);
+}
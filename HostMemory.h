@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// NUMA node placement for host-side particle system arrays
+#define HOST_NODE_ANY			0xFFFFFFFF	// the node of the calling thread
+#define HOST_NODE_INTERLEAVED	0xFFFFFFFE	// HOST_PAGE_ALLOC_MIN stripes over every node in turn
+
+// Allocations this big or bigger get their own pages on the requested node,
+// in large pages when the account holds SeLockMemoryPrivilege; smaller ones
+// go to the heap
+#define HOST_PAGE_ALLOC_MIN	(64 * 1024)
+
+void* HostAlloc(size_t bytes, uint32_t node);
+void HostFree(void* ptr, size_t bytes);
+
+// NUMA node of the processor the calling thread runs on
+uint32_t HostCurrentNode();
+
+uint32_t HostNodeCount();
+
+// Keeps the calling thread on the processors of `node`, so that what it
+// allocated there stays local. False if the node has no processors
+bool HostPinThread(uint32_t node);
+
+// Standard allocator placing containers on one NUMA node
+template <typename T>
+class HostAllocator
+{
+public:
+	typedef T value_type;
+
+	// the node travels with the container's contents
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	HostAllocator(uint32_t node = HOST_NODE_ANY) : node(node) {}
+
+	template <typename U>
+	HostAllocator(const HostAllocator<U>& other) : node(other.node) {}
+
+	T* allocate(size_t n) { return static_cast<T*>(HostAlloc(n * sizeof(T), node)); }
+	void deallocate(T* ptr, size_t n) { HostFree(ptr, n * sizeof(T)); }
+
+	uint32_t node;
+};
+
+template <typename T, typename U>
+bool operator==(const HostAllocator<T>& a, const HostAllocator<U>& b) { return a.node == b.node; }
+
+template <typename T, typename U>
+bool operator!=(const HostAllocator<T>& a, const HostAllocator<U>& b) { return a.node != b.node; }
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include "HostReorder.h"
+
+#include "ParticleReorder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+	// inserts two zero bits between each of the low 10 bits, as
+	// ParticleSortKeysCS does
+	uint32_t SpreadBits(uint32_t x)
+	{
+		x &= 0x000003FF;
+		x = (x | (x << 16)) & 0xFF0000FF;
+		x = (x | (x << 8)) & 0x0300F00F;
+		x = (x | (x << 4)) & 0x030C30C3;
+		x = (x | (x << 2)) & 0x09249249;
+		return x;
+	}
+
+	uint32_t CellOf(float coordinate, float cellSize)
+	{
+		return (uint32_t)((int32_t)floorf(coordinate / cellSize) + (1 << (REORDER_AXIS_BITS - 1)));
+	}
+
+	uint32_t SortKey(const Particle& p, float cellSize)
+	{
+		if (p.emitter == PARTICLE_DEAD)
+			return REORDER_KEY_DEAD;
+
+		return SpreadBits(CellOf(p.position.x, cellSize))
+			| (SpreadBits(CellOf(p.position.y, cellSize)) << 1)
+			| (SpreadBits(CellOf(p.position.z, cellSize)) << 2);
+	}
+}
+
+uint32_t HostMortonSort(Particle * particles, uint32_t count, float cellSize)
+{
+	// key in the high half, so slot order breaks ties and the sort is stable
+	std::vector<uint64_t> keys(count);
+	for (uint32_t i = 0; i < count; ++i)
+		keys[i] = ((uint64_t)SortKey(particles[i], cellSize) << 32) | i;
+
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<Particle> sorted(count);
+	uint32_t live = 0;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		sorted[i] = particles[(uint32_t)keys[i]];
+		if (sorted[i].emitter != PARTICLE_DEAD)
+			live++;
+	}
+
+	std::copy(sorted.begin(), sorted.end(), particles);
+	return live;
+}
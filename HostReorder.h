@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Particle.h"
+
+// Sorts host-side particles in place by the Morton code of their cell on a
+// grid of cellSize, the same order ParticleSortKeysCS gives pool slots, with
+// the dead ones after every live one. Returns how many are live. Only for
+// arrays nothing else refers into by index, unlike recorder frames, whose
+// encoding relies on slots staying put
+uint32_t HostMortonSort(Particle* particles, uint32_t count, float cellSize);
@@ -0,0 +1,134 @@
+#include "HostSimulate.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// particles per run of the module program, small enough that the
+	// passes over them around it stay in cache
+	const uint32_t CHUNK_PARTICLES = 256;
+
+	// events past the capacity are only counted
+	void PushEvent(const HostSimulateParams& params, uint32_t type, uint32_t index, const XMFLOAT3& position)
+	{
+		if (0 == (params.eventMask & (1u << type)))
+			return;
+
+		uint32_t slot = (*params.eventCount)++;
+		if (slot < params.eventCapacity)
+		{
+			ParticleEvent e;
+			e.position = position;
+			e.type = type;
+			e.particle = params.slotBase + index;
+			e._padding = 0;
+			params.events[slot] = e;
+		}
+	}
+}
+
+template <uint32_t Features>
+void HostSimulate(Particle * particles, uint32_t count, const HostSimulateParams & params)
+{
+	const float dt = params.deltaTime;
+	const XMFLOAT4& plane = params.collidePlane;
+
+	for (uint32_t base = 0; base < count; base += CHUNK_PARTICLES)
+	{
+		uint32_t chunk = min(count - base, CHUNK_PARTICLES);
+		Particle* batch = particles + base;
+
+		// the life time is read every step, as on the GPU
+		for (uint32_t i = 0; i < chunk; ++i)
+		{
+			Particle& p = batch[i];
+			if (p.emitter == PARTICLE_DEAD)
+				continue;
+
+			p.age += dt;
+			if (p.age > params.emitterParams[p.emitter].lifeTime)
+			{
+				if (Features & HOST_FEATURE_EVENTS)
+					PushEvent(params, PARTICLE_EVENT_DEATH, base + i, p.position);
+				p.emitter = PARTICLE_DEAD;
+			}
+		}
+
+		if (Features & HOST_FEATURE_MODULES)
+		{
+			uint32_t moduleEvents[CHUNK_PARTICLES];
+			ParticleModuleGraph::Run(*params.program, PARTICLE_STAGE_UPDATE, batch, chunk, params.emitterParams, dt, params.totalTime,
+				(Features & HOST_FEATURE_EVENTS) ? moduleEvents : nullptr, params.batchVariant);
+
+			if (Features & HOST_FEATURE_EVENTS)
+			{
+				for (uint32_t i = 0; i < chunk; ++i)
+				{
+					if (moduleEvents[i] & (1u << PARTICLE_EVENT_COLLIDE))
+						PushEvent(params, PARTICLE_EVENT_COLLIDE, base + i, batch[i].position);
+				}
+			}
+		}
+
+		for (uint32_t i = 0; i < chunk; ++i)
+		{
+			Particle& p = batch[i];
+			if (p.emitter == PARTICLE_DEAD)
+				continue;
+
+			if (Features & HOST_FEATURE_FORCES)
+			{
+				const EmitterParams& emitter = params.emitterParams[p.emitter];
+				float keep = 1 - emitter.drag * dt;
+				keep = keep < 0 ? 0 : (keep > 1 ? 1 : keep);
+				p.velocity.x = (p.velocity.x + emitter.gravity.x * dt) * keep;
+				p.velocity.y = (p.velocity.y + emitter.gravity.y * dt) * keep;
+				p.velocity.z = (p.velocity.z + emitter.gravity.z * dt) * keep;
+			}
+
+			p.position.x += p.velocity.x * dt;
+			p.position.y += p.velocity.y * dt;
+			p.position.z += p.velocity.z * dt;
+
+			// like MODULE_OP_COLLIDE: pushed back onto the plane, bounced
+			// if still heading into it
+			if (Features & HOST_FEATURE_COLLIDE)
+			{
+				float depth = p.position.x * plane.x + p.position.y * plane.y + p.position.z * plane.z - plane.w;
+				float approach = p.velocity.x * plane.x + p.velocity.y * plane.y + p.velocity.z * plane.z;
+				if (depth < 0 && approach < 0)
+				{
+					float bounce = approach * (1 + params.restitution);
+					p.position = XMFLOAT3(p.position.x - plane.x * depth, p.position.y - plane.y * depth, p.position.z - plane.z * depth);
+					p.velocity = XMFLOAT3(p.velocity.x - plane.x * bounce, p.velocity.y - plane.y * bounce, p.velocity.z - plane.z * bounce);
+
+					if (Features & HOST_FEATURE_EVENTS)
+						PushEvent(params, PARTICLE_EVENT_COLLIDE, base + i, p.position);
+				}
+			}
+		}
+	}
+}
+
+void HostSimulate(uint32_t features, Particle * particles, uint32_t count, const HostSimulateParams & params)
+{
+	switch (features & (HOST_FEATURE_MASKS - 1))
+	{
+	case 0:	HostSimulate<0>(particles, count, params); break;
+	case 1:	HostSimulate<1>(particles, count, params); break;
+	case 2:	HostSimulate<2>(particles, count, params); break;
+	case 3:	HostSimulate<3>(particles, count, params); break;
+	case 4:	HostSimulate<4>(particles, count, params); break;
+	case 5:	HostSimulate<5>(particles, count, params); break;
+	case 6:	HostSimulate<6>(particles, count, params); break;
+	case 7:	HostSimulate<7>(particles, count, params); break;
+	case 8:	HostSimulate<8>(particles, count, params); break;
+	case 9:	HostSimulate<9>(particles, count, params); break;
+	case 10:	HostSimulate<10>(particles, count, params); break;
+	case 11:	HostSimulate<11>(particles, count, params); break;
+	case 12:	HostSimulate<12>(particles, count, params); break;
+	case 13:	HostSimulate<13>(particles, count, params); break;
+	case 14:	HostSimulate<14>(particles, count, params); break;
+	default:	HostSimulate<15>(particles, count, params); break;
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+#include "EmitterParams.h"
+#include "ParticleEvents.h"
+#include "ParticleModuleGraph.h"
+
+// Optional features of the CPU simulate step, the host counterpart of
+// ParticleFeatures.h. Each combination is its own instantiation of
+// HostSimulate<Features>, so a step only pays for what it uses
+#define HOST_FEATURE_MODULES	1	// run the update module program
+#define HOST_FEATURE_FORCES		2	// gravity and drag of the EmitterParams
+#define HOST_FEATURE_COLLIDE	4	// bounce off collidePlane
+#define HOST_FEATURE_EVENTS		8	// write death and collision events
+#define HOST_FEATURE_MASKS		16
+
+struct HostSimulateParams
+{
+	float							deltaTime;
+	float							totalTime;
+	const EmitterParams*			emitterParams;	// indexed by Particle::emitter
+	const ParticleProgram*			program;		// HOST_FEATURE_MODULES
+	uint32_t						batchVariant;	// of ParticleModuleGraph::Run
+	DirectX::XMFLOAT4				collidePlane;	// HOST_FEATURE_COLLIDE: xyz normal, w offset
+	float							restitution;
+
+	// HOST_FEATURE_EVENTS, as ParticleCS writes them: (1 << PARTICLE_EVENT_*)
+	// bits of eventMask are reported, the first eventCapacity of them into
+	// events, and eventCount counts them all. ParticleEvent::particle is the
+	// index plus slotBase, so a host copy of a pool numbers slots as the
+	// pool does. Hand them to ParticleSystem::PostEvents
+	ParticleEvent*					events;
+	uint32_t						eventMask;
+	uint32_t						eventCapacity;
+	uint32_t*						eventCount;
+	uint32_t						slotBase;
+};
+
+// Ages, kills, and moves host-side particles the way ParticleCS does one
+// frame on the GPU, with only the features in the mask compiled in
+template <uint32_t Features>
+void HostSimulate(Particle* particles, uint32_t count, const HostSimulateParams& params);
+
+// Picks the instantiation for `features` at run time
+void HostSimulate(uint32_t features, Particle* particles, uint32_t count, const HostSimulateParams& params);
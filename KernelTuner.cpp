@@ -0,0 +1,215 @@
+#include "KernelTuner.h"
+
+#include "ParticleModuleGraph.h"
+
+#include <fstream>
+
+// whether every workload of the bucket fits in one dispatch of the
+// variant; small groups run out of groups first
+static bool Fits(unsigned int kernel, unsigned int variant, unsigned int b)
+{
+	if (kernel == TUNED_KERNEL_DRAW || kernel == TUNED_KERNEL_HOST_MODULES)
+		return true;
+
+	unsigned long long groups = ((1ull << b) + KERNEL_VARIANT_THREADS[variant] - 1) / KERNEL_VARIANT_THREADS[variant];
+	return groups <= D3D11_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION;
+}
+
+// what the cache file keeps of a variant: the group size of compute
+// kernels, the strategy itself for draws, the batch size on the CPU
+static unsigned int VariantKey(unsigned int kernel, unsigned int variant)
+{
+	switch (kernel)
+	{
+	case TUNED_KERNEL_DRAW:			return variant;
+	case TUNED_KERNEL_HOST_MODULES:	return MODULE_BATCH_SIZES[variant];
+	default:						return KERNEL_VARIANT_THREADS[variant];
+	}
+}
+
+// GpuTimer tags of the tuner's timings
+static unsigned int TimingTag(unsigned int kernel, unsigned int b, unsigned int variant)
+{
+	return (kernel * KERNEL_TUNER_BUCKETS + b) * KERNEL_TUNER_MAX_VARIANTS + variant;
+}
+
+KernelTuner::KernelTuner()
+{
+	for (unsigned int k = 0; k < TUNED_KERNEL_COUNT; ++k)
+	{
+		for (unsigned int b = 0; b < KERNEL_TUNER_BUCKETS; ++b)
+		{
+			Bucket& bucket = buckets[k][b];
+			bucket.winner = -1;
+			for (unsigned int v = 0; v < KERNEL_TUNER_MAX_VARIANTS; ++v)
+			{
+				bucket.seconds[v] = 0.0;
+				bucket.samples[v] = 0;
+			}
+		}
+	}
+}
+
+void KernelTuner::Init(ID3D11Device* device, ID3D11DeviceContext* context, const std::wstring& cacheFile)
+{
+	this->cacheFile = cacheFile;
+
+	if (nullptr != device)
+		timer.Init(device, context);
+
+	Load();
+}
+
+void KernelTuner::CleanUp()
+{
+	timer.CleanUp();
+}
+
+void KernelTuner::BeginFrame()
+{
+	landed.clear();
+	timer.BeginFrame(landed);
+
+	bool decided = false;
+	for (auto iter = landed.begin(); iter != landed.end(); ++iter)
+	{
+		unsigned int variant = iter->tag % KERNEL_TUNER_MAX_VARIANTS;
+		unsigned int b = iter->tag / KERNEL_TUNER_MAX_VARIANTS % KERNEL_TUNER_BUCKETS;
+		unsigned int kernel = iter->tag / KERNEL_TUNER_MAX_VARIANTS / KERNEL_TUNER_BUCKETS;
+
+		Bucket& bucket = buckets[kernel][b];
+		if (bucket.winner >= 0)
+			continue;
+
+		bucket.seconds[variant] += iter->seconds;
+		bucket.samples[variant]++;
+
+		Decide(kernel, b);
+		decided |= bucket.winner >= 0;
+	}
+
+	if (decided)
+		Save();
+}
+
+void KernelTuner::EndFrame()
+{
+	timer.EndFrame();
+}
+
+unsigned int KernelTuner::BucketOf(unsigned int threads)
+{
+	unsigned int b = 0;
+	while (b + 1 < KERNEL_TUNER_BUCKETS && (1u << b) < threads)
+		++b;
+	return b;
+}
+
+unsigned int KernelTuner::Begin(TunedKernel kernel, unsigned int threads)
+{
+	unsigned int b = BucketOf(threads);
+
+	Bucket& bucket = buckets[kernel][b];
+	if (bucket.winner >= 0)
+		return bucket.winner;
+
+	// round-robin over the variants that still need samples. Past what
+	// even the largest groups can dispatch, the caller has to split the work
+	int variant = -1;
+	for (unsigned int v = 0; v < TUNED_KERNEL_VARIANTS[kernel]; ++v)
+	{
+		if (Fits(kernel, v, b) && (variant < 0 || bucket.samples[v] < bucket.samples[variant]))
+			variant = v;
+	}
+	if (variant < 0)
+		return TUNED_KERNEL_VARIANTS[kernel] - 1;
+
+	if (kernel != TUNED_KERNEL_HOST_MODULES)
+		timer.Begin(TimingTag(kernel, b, variant));
+
+	return variant;
+}
+
+void KernelTuner::End()
+{
+	timer.End();
+}
+
+void KernelTuner::Report(TunedKernel kernel, unsigned int threads, unsigned int variant, double seconds)
+{
+	unsigned int b = BucketOf(threads);
+
+	Bucket& bucket = buckets[kernel][b];
+	if (bucket.winner >= 0 || variant >= TUNED_KERNEL_VARIANTS[kernel])
+		return;
+
+	bucket.seconds[variant] += seconds;
+	bucket.samples[variant]++;
+
+	Decide(kernel, b);
+	if (bucket.winner >= 0)
+		Save();
+}
+
+int KernelTuner::GetWinner(TunedKernel kernel, unsigned int threads) const
+{
+	return buckets[kernel][BucketOf(threads)].winner;
+}
+
+void KernelTuner::Decide(unsigned int kernel, unsigned int b)
+{
+	Bucket& bucket = buckets[kernel][b];
+
+	int best = -1;
+	for (unsigned int v = 0; v < TUNED_KERNEL_VARIANTS[kernel]; ++v)
+	{
+		if (!Fits(kernel, v, b))
+			continue;
+
+		if (bucket.samples[v] < SAMPLES_PER_VARIANT)
+			return;
+
+		if (best < 0 || bucket.seconds[v] / bucket.samples[v] < bucket.seconds[best] / bucket.samples[best])
+			best = v;
+	}
+
+	bucket.winner = best;
+}
+
+void KernelTuner::Load()
+{
+	std::wifstream file(cacheFile);
+	if (!file.is_open())
+		return;
+
+	// one "<kernel> <bucket> <variant key>" line per tuned bucket
+	unsigned int kernel, b, key;
+	while (file >> kernel >> b >> key)
+	{
+		if (kernel >= TUNED_KERNEL_COUNT || b >= KERNEL_TUNER_BUCKETS)
+			continue;
+
+		// a cache from before a variant was ruled out may still name it
+		for (unsigned int v = 0; v < TUNED_KERNEL_VARIANTS[kernel]; ++v)
+		{
+			if (VariantKey(kernel, v) == key && Fits(kernel, v, b))
+				buckets[kernel][b].winner = v;
+		}
+	}
+}
+
+void KernelTuner::Save() const
+{
+	std::wofstream file(cacheFile);
+	if (!file.is_open())
+		return;
+
+	for (unsigned int k = 0; k < TUNED_KERNEL_COUNT; ++k)
+	{
+		for (unsigned int b = 0; b < KERNEL_TUNER_BUCKETS; ++b)
+		{
+			if (buckets[k][b].winner >= 0)
+				file << k << L" " << b << L" " << VariantKey(k, buckets[k][b].winner) << std::endl;
+		}
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <string>
+#include <vector>
+
+#include "GpuTimer.h"
+
+// Compute kernels that are built in several thread-group sizes
+enum TunedKernel
+{
+	TUNED_KERNEL_SIMULATE,		// ParticleCS
+	TUNED_KERNEL_EMIT,			// ParticleEmitterCS
+	TUNED_KERNEL_DRAW,			// particle draws, the variants are ParticleDrawStrategy
+	TUNED_KERNEL_HOST_MODULES,	// ParticleModuleGraph::Run, the variants are MODULE_BATCH_SIZES
+	TUNED_KERNEL_COUNT
+};
+
+// Group-size variants, compiled from <Kernel><suffix>.hlsl wrappers
+#define KERNEL_VARIANT_COUNT	3
+static const unsigned int KERNEL_VARIANT_THREADS[KERNEL_VARIANT_COUNT] = { 64, 256, 1024 };
+static const wchar_t* const KERNEL_VARIANT_SUFFIX[KERNEL_VARIANT_COUNT] = { L"64", L"256", L"" };
+
+// Draw strategies, PARTICLE_DRAW_STRATEGY_COUNT
+#define DRAW_VARIANT_COUNT		3
+
+// CPU batch sizes, MODULE_BATCH_VARIANT_COUNT
+#define HOST_VARIANT_COUNT		2
+
+// Variants of each kernel, and the most any of them has
+static const unsigned int TUNED_KERNEL_VARIANTS[TUNED_KERNEL_COUNT] = { KERNEL_VARIANT_COUNT, KERNEL_VARIANT_COUNT, DRAW_VARIANT_COUNT, HOST_VARIANT_COUNT };
+#define KERNEL_TUNER_MAX_VARIANTS	3
+
+// Workloads are told apart by the log2 of their thread count
+#define KERNEL_TUNER_BUCKETS	32
+
+// Picks a variant (group size, or draw strategy) per kernel and workload
+// size by timing the variants on the real work of the first frames, then
+// sticks with the fastest. Winners are kept in a small text cache file so
+// later runs start tuned; delete it after changing GPU or driver
+class KernelTuner
+{
+public:
+	KernelTuner();
+
+	// A tuner of host kernels alone needs no device, nor BeginFrame/EndFrame
+	void Init(ID3D11Device* device, ID3D11DeviceContext* context, const std::wstring& cacheFile);
+
+	void CleanUp();
+
+	// Bracket everything that goes through Begin/End in a frame
+	void BeginFrame();
+	void EndFrame();
+
+	// Variant to dispatch `threads` threads of `kernel` with. Group sizes
+	// too small to dispatch that many threads at once are never picked.
+	// Every Begin must be followed by End right after the dispatch
+	unsigned int Begin(TunedKernel kernel, unsigned int threads);
+	void End();
+
+	// Host kernels are timed by the caller instead: Begin picks the variant
+	// as usual, and Report hands back how long it took
+	void Report(TunedKernel kernel, unsigned int threads, unsigned int variant, double seconds);
+
+	// Variant that won for this workload, or -1 while it's still being timed
+	int GetWinner(TunedKernel kernel, unsigned int threads) const;
+
+private:
+	static const unsigned int SAMPLES_PER_VARIANT = 8;
+
+	struct Bucket
+	{
+		int							winner;		// -1 while still tuning
+		double						seconds[KERNEL_TUNER_MAX_VARIANTS];
+		unsigned int				samples[KERNEL_TUNER_MAX_VARIANTS];
+	};
+
+	static unsigned int BucketOf(unsigned int threads);
+
+	void Decide(unsigned int kernel, unsigned int b);
+	void Load();
+	void Save() const;
+
+	std::wstring					cacheFile;
+
+	Bucket							buckets[TUNED_KERNEL_COUNT][KERNEL_TUNER_BUCKETS];
+
+	// tagged with (kernel, bucket, variant)
+	GpuTimer						timer;
+	std::vector<GpuTiming>			landed;
+};
@@ -3,10 +3,17 @@
 
 #include "ShaderCommon.h"
 
+// Emitter index of a free slot
+#define PARTICLE_DEAD	0xFFFFFFFF
+
+// Everything that is the same for all particles of an emitter lives in its
+// EmitterParams instead, looked up through `emitter`
 struct Particle
 {
-	float4		position;	// w = age
-	float4		velocity;	// w = life time
+	float3		position;
+	float		age;		// spawn time instead in stateless pools, see ParticlePoolDesc
+	float3		velocity;
+	uint		emitter;	// index into the pool's emitter parameters, PARTICLE_DEAD when free
 };
 
 #endif 
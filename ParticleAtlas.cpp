@@ -0,0 +1,226 @@
+#include "ParticleAtlas.h"
+#include "ParticleSystem.h"
+
+#include <WICTextureLoader.h>
+
+#include <algorithm>
+#include <cassert>
+
+ParticleAtlasPacker::ParticleAtlasPacker(uint32_t width, uint32_t height)
+	:
+	width(width),
+	height(height)
+{
+	Segment floor = { 0, 0, width };
+	skyline.push_back(floor);
+}
+
+bool ParticleAtlasPacker::Pack(uint32_t w, uint32_t h, uint32_t & x, uint32_t & y)
+{
+	// lowest spot, then leftmost, where the rectangle rests on the skyline
+	uint32_t best = (uint32_t)skyline.size();
+	uint32_t bestY = height;
+	for (uint32_t i = 0; i < skyline.size(); ++i)
+	{
+		if (skyline[i].x + w > width)
+			break;
+
+		uint32_t top = 0;
+		uint32_t covered = 0;
+		for (uint32_t j = i; covered < w; ++j)
+		{
+			top = max(top, skyline[j].y);
+			covered += skyline[j].width;
+		}
+
+		if (top + h <= height && top < bestY)
+		{
+			best = i;
+			bestY = top;
+		}
+	}
+
+	if (best == skyline.size())
+		return false;
+
+	x = skyline[best].x;
+	y = bestY;
+
+	// the rectangle's top replaces the segments it covers
+	Segment placed = { x, y + h, w };
+	skyline.insert(skyline.begin() + best, placed);
+
+	uint32_t i = best + 1;
+	while (i < skyline.size() && skyline[i].x < x + w)
+	{
+		uint32_t overlap = min(x + w - skyline[i].x, skyline[i].width);
+		skyline[i].x += overlap;
+		skyline[i].width -= overlap;
+		if (0 == skyline[i].width)
+			skyline.erase(skyline.begin() + i);
+		else
+			++i;
+	}
+
+	// merge neighbours at the same height
+	for (i = 0; i + 1 < skyline.size();)
+	{
+		if (skyline[i].y == skyline[i + 1].y)
+		{
+			skyline[i].width += skyline[i + 1].width;
+			skyline.erase(skyline.begin() + i + 1);
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	return true;
+}
+
+bool ParticleSystem::CreateAtlasPool(const std::vector<std::wstring>& texFileNames, const ParticlePoolDesc & desc)
+{
+	if (texFileNames.empty())
+		return false;
+	for (auto iName = texFileNames.begin(); iName != texFileNames.end(); ++iName)
+	{
+		if (poolMap.find(*iName) != poolMap.end())
+			return false;
+	}
+
+	// decoded as RGBA8 into textures the CPU can read
+	struct Image
+	{
+		ID3D11Texture2D*	texture;
+		uint32_t			width;
+		uint32_t			height;
+		uint32_t			x;
+		uint32_t			y;
+	};
+	std::vector<Image> images(texFileNames.size());
+
+	bool ok = true;
+	uint64_t area = 0;
+	uint32_t widest = 0;
+	for (uint32_t i = 0; i < images.size(); ++i)
+	{
+		ID3D11Resource* resource = nullptr;
+		HRESULT hr = DirectX::CreateWICTextureFromFileEx(device, texFileNames[i].c_str(), 0,
+			D3D11_USAGE_STAGING, 0, D3D11_CPU_ACCESS_READ, 0, DirectX::WIC_LOADER_FORCE_RGBA32, &resource, nullptr);
+
+		images[i].texture = static_cast<ID3D11Texture2D*>(resource);
+		if (hr != S_OK)
+		{
+			ok = false;
+			continue;
+		}
+
+		D3D11_TEXTURE2D_DESC texDesc;
+		images[i].texture->GetDesc(&texDesc);
+		images[i].width = texDesc.Width;
+		images[i].height = texDesc.Height;
+
+		area += (uint64_t)(texDesc.Width + 2 * PARTICLE_ATLAS_GUTTER) * (texDesc.Height + 2 * PARTICLE_ATLAS_GUTTER);
+		widest = max(widest, texDesc.Width + 2 * PARTICLE_ATLAS_GUTTER);
+	}
+
+	// tallest first, then grow the atlas until everything fits
+	std::vector<uint32_t> order(images.size());
+	for (uint32_t i = 0; i < order.size(); ++i)
+		order[i] = i;
+	std::sort(order.begin(), order.end(),
+		[&images](uint32_t a, uint32_t b) { return images[a].height > images[b].height; });
+
+	uint32_t atlasWidth = 1;
+	while (atlasWidth < widest || (uint64_t)atlasWidth * atlasWidth < area)
+		atlasWidth <<= 1;
+	uint32_t atlasHeight = atlasWidth;
+
+	bool packed = false;
+	while (ok && !packed && atlasWidth <= D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION && atlasHeight <= D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION)
+	{
+		ParticleAtlasPacker packer(atlasWidth, atlasHeight);
+
+		packed = true;
+		for (auto iImage = order.begin(); packed && iImage != order.end(); ++iImage)
+		{
+			Image& image = images[*iImage];
+			packed = packer.Pack(image.width + 2 * PARTICLE_ATLAS_GUTTER, image.height + 2 * PARTICLE_ATLAS_GUTTER, image.x, image.y);
+		}
+
+		if (!packed && atlasHeight < atlasWidth)
+			atlasHeight <<= 1;
+		else if (!packed)
+			atlasWidth <<= 1;
+	}
+	ok = ok && packed;
+
+	ID3D11ShaderResourceView* texSRV = nullptr;
+	std::vector<DirectX::XMFLOAT4> atlasRects;
+	if (ok)
+	{
+		// each image goes in with its edge texels repeated into the gutter
+		std::vector<uint32_t> texels((size_t)atlasWidth * atlasHeight, 0);
+		for (auto iImage = images.begin(); iImage != images.end(); ++iImage)
+		{
+			D3D11_MAPPED_SUBRESOURCE mapped = {};
+			HRESULT hr = context->Map(iImage->texture, 0, D3D11_MAP_READ, 0, &mapped);
+			assert(hr == S_OK);
+
+			const int32_t gutter = PARTICLE_ATLAS_GUTTER;
+			for (int32_t row = -gutter; row < (int32_t)iImage->height + gutter; ++row)
+			{
+				int32_t srcRow = min(max(row, 0), (int32_t)iImage->height - 1);
+				const uint32_t* src = reinterpret_cast<const uint32_t*>(static_cast<const uint8_t*>(mapped.pData) + (size_t)srcRow * mapped.RowPitch);
+				uint32_t* dst = &texels[(size_t)(iImage->y + gutter + row) * atlasWidth + iImage->x + gutter];
+
+				for (int32_t col = -gutter; col < (int32_t)iImage->width + gutter; ++col)
+					dst[col] = src[min(max(col, 0), (int32_t)iImage->width - 1)];
+			}
+
+			context->Unmap(iImage->texture, 0);
+
+			atlasRects.push_back(DirectX::XMFLOAT4(
+				(float)(iImage->x + gutter) / atlasWidth,
+				(float)(iImage->y + gutter) / atlasHeight,
+				(float)iImage->width / atlasWidth,
+				(float)iImage->height / atlasHeight));
+		}
+
+		D3D11_SUBRESOURCE_DATA data = { texels.data(), atlasWidth * 4, 0 };
+		CD3D11_TEXTURE2D_DESC atlasDesc(DXGI_FORMAT_R8G8B8A8_UNORM, atlasWidth, atlasHeight, 1, 1, D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_IMMUTABLE);
+
+		ID3D11Texture2D* atlas = nullptr;
+		HRESULT hr = device->CreateTexture2D(&atlasDesc, &data, &atlas);
+		assert(hr == S_OK);
+
+		hr = device->CreateShaderResourceView(atlas, nullptr, &texSRV);
+		assert(hr == S_OK);
+		atlas->Release();
+	}
+
+	for (auto iImage = images.begin(); iImage != images.end(); ++iImage)
+	{
+		if (nullptr != iImage->texture)
+			iImage->texture->Release();
+	}
+
+	if (!ok)
+		return false;
+
+	uint32_t first = (uint32_t)pools.size();
+	CreatePoolChunks(texFileNames[0], texSRV, desc);
+
+	for (uint32_t i = 0; i < pools[first].chunkCount; ++i)
+		pools[first + i].atlasRects = atlasRects;
+
+	// every texture of the atlas names the same pool
+	for (uint32_t i = 0; i < texFileNames.size(); ++i)
+	{
+		poolMap.insert(std::pair<std::wstring, uint32_t>{texFileNames[i], first});
+		atlasTextures.insert(std::pair<std::wstring, uint32_t>{texFileNames[i], i});
+	}
+
+	return true;
+}
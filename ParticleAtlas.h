@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Empty texels left around every texture packed into an atlas, filled with
+// copies of its edge so bilinear filtering never reaches a neighbour
+#define PARTICLE_ATLAS_GUTTER	1
+
+// Packs rectangles into a fixed-size area, bottom-left first along a
+// skyline: the top edge of everything placed so far, kept as a list of
+// horizontal segments. Rectangles should be added tallest first
+class ParticleAtlasPacker
+{
+public:
+	ParticleAtlasPacker(uint32_t width, uint32_t height);
+
+	// Finds room for a width x height rectangle and returns its corner, or
+	// false if it doesn't fit anywhere
+	bool Pack(uint32_t width, uint32_t height, uint32_t& x, uint32_t& y);
+
+private:
+	struct Segment
+	{
+		uint32_t	x;
+		uint32_t	y;		// top of what is below this segment
+		uint32_t	width;
+	};
+
+	std::vector<Segment>	skyline;
+	uint32_t				width;
+	uint32_t				height;
+};
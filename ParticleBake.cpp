@@ -0,0 +1,126 @@
+#include "ParticleBake.h"
+
+#include "ParticleSystem.h"
+
+#include <windows.h>
+
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+	// leaves `in` just past the switch, false if it isn't there
+	bool FindSwitch(std::wistringstream& in, const wchar_t* name)
+	{
+		std::wstring token;
+		while (in >> std::quoted(token))
+		{
+			if (token == name)
+				return true;
+		}
+		return false;
+	}
+}
+
+bool ParticleBake::Run(const ParticleBakeDesc & desc)
+{
+	wchar_t exe[MAX_PATH] = {};
+	DWORD length = GetModuleFileNameW(nullptr, exe, MAX_PATH);
+	if (0 == length || MAX_PATH == length)
+		return false;
+
+	bool ok = true;
+	std::vector<HANDLE> workers;
+	for (uint32_t i = 0; i < desc.shardCount; ++i)
+	{
+		std::wostringstream args;
+		args << std::quoted(exe) << L" " << PARTICLE_BAKE_SHARD_SWITCH << L" " << i << L" " << desc.shardCount << L" "
+			<< desc.frameCount << L" " << desc.frameRate << L" " << std::quoted(ShardFileName(desc.outputPrefix, i));
+
+		// CreateProcessW may write to the command line
+		std::wstring commandLine = args.str();
+		STARTUPINFOW startup = {};
+		startup.cb = sizeof(startup);
+		PROCESS_INFORMATION process = {};
+		if (!CreateProcessW(exe, &commandLine[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startup, &process))
+		{
+			ok = false;
+			break;
+		}
+
+		CloseHandle(process.hThread);
+		workers.push_back(process.hProcess);
+	}
+
+	for (auto iWorker = workers.begin(); iWorker != workers.end(); ++iWorker)
+	{
+		DWORD exitCode = 1;
+		WaitForSingleObject(*iWorker, INFINITE);
+		GetExitCodeProcess(*iWorker, &exitCode);
+		CloseHandle(*iWorker);
+
+		ok = ok && 0 == exitCode;
+	}
+
+	return ok;
+}
+
+bool ParticleBake::ParseCoordinator(const wchar_t * commandLine, ParticleBakeDesc & desc)
+{
+	std::wistringstream in(commandLine);
+	if (!FindSwitch(in, PARTICLE_BAKE_SWITCH))
+		return false;
+
+	ParticleBakeDesc parsed;
+	in >> parsed.shardCount >> parsed.frameCount >> parsed.frameRate >> std::quoted(parsed.outputPrefix);
+	if (in.fail() || 0 == parsed.shardCount || !(parsed.frameRate > 0))
+		return false;
+
+	desc = parsed;
+	return true;
+}
+
+bool ParticleBake::ParseWorker(const wchar_t * commandLine, ParticleBakeShard & shard)
+{
+	std::wistringstream in(commandLine);
+	if (!FindSwitch(in, PARTICLE_BAKE_SHARD_SWITCH))
+		return false;
+
+	ParticleBakeShard parsed = {};
+	in >> parsed.index >> parsed.count >> parsed.frameCount >> parsed.frameRate >> std::quoted(parsed.outputFile);
+	if (in.fail() || parsed.index >= parsed.count || !(parsed.frameRate > 0))
+		return false;
+
+	shard = parsed;
+	return true;
+}
+
+bool ParticleBake::RunWorker(ParticleSystem & system, const std::wstring & particleTexture, const ParticleBakeShard & shard,
+	const std::function<void(float deltaTime, float totalTime)>& step)
+{
+	if (!system.SetShard(shard.index, shard.count))
+		return false;
+
+	ParticleRecorderDesc recorderDesc;
+	recorderDesc.lossless = true;
+	if (!system.StartRecording(particleTexture, shard.outputFile, recorderDesc))
+		return false;
+
+	float deltaTime = 1.0f / shard.frameRate;
+	for (uint32_t frame = 0; frame < shard.frameCount; ++frame)
+	{
+		float totalTime = (frame + 1) * deltaTime;
+		if (step)
+			step(deltaTime, totalTime);
+		system.Update(deltaTime, totalTime);
+	}
+
+	ParticleRecorderStats stats = {};
+	return system.StopRecording(particleTexture, &stats) && stats.framesWritten == shard.frameCount;
+}
+
+std::wstring ParticleBake::ShardFileName(const std::wstring & outputPrefix, uint32_t index)
+{
+	return outputPrefix + std::to_wstring(index) + L".prec";
+}
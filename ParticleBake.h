@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+class ParticleSystem;
+
+// Command line switches, see ParticleBake
+#define PARTICLE_BAKE_SWITCH		L"-bake"		// <shards> <frames> <frame rate> <output prefix>
+#define PARTICLE_BAKE_SHARD_SWITCH	L"-bakeShard"	// <index> <count> <frames> <frame rate> <output file>
+
+struct ParticleBakeDesc
+{
+	uint32_t						shardCount;		// worker processes
+	uint32_t						frameCount;
+	float							frameRate;		// simulated frames per second of the bake
+	std::wstring					outputPrefix;	// see ParticleBake::ShardFileName
+
+	ParticleBakeDesc()
+		:
+		shardCount(4),
+		frameCount(600),
+		frameRate(60.0f)
+	{}
+};
+
+// What one worker process bakes
+struct ParticleBakeShard
+{
+	uint32_t						index;
+	uint32_t						count;
+	uint32_t						frameCount;
+	float							frameRate;
+	std::wstring					outputFile;
+};
+
+// Bakes one effect offline across several processes on one machine, each
+// with its own pools and GPU memory. The coordinator starts a copy of
+// this executable per shard and waits for them. Every worker simulates
+// its index shard (see ParticleSystem::SetShard) at a fixed step and
+// streams it to its own file through a lossless recording. Particles
+// never interact, so workers share nothing while they run. The result
+// plays back as one playback pool per shard file
+class ParticleBake
+{
+public:
+	// Coordinator side. Fails if a worker couldn't be started or didn't
+	// exit with 0; the ones that did start are always waited for
+	static bool Run(const ParticleBakeDesc& desc);
+
+	// True if the command line asks for a bake, or is a worker's
+	static bool ParseCoordinator(const wchar_t* commandLine, ParticleBakeDesc& desc);
+	static bool ParseWorker(const wchar_t* commandLine, ParticleBakeShard& shard);
+
+	// Worker side: shards the system, then steps it frameCount times,
+	// recording the pool. step, if given, runs before every Update to
+	// move the effect's emitters. The emitters may already exist
+	static bool RunWorker(ParticleSystem& system, const std::wstring& particleTexture, const ParticleBakeShard& shard,
+		const std::function<void(float deltaTime, float totalTime)>& step = nullptr);
+
+	// <outputPrefix><index>.prec
+	static std::wstring ShardFileName(const std::wstring& outputPrefix, uint32_t index);
+};
@@ -0,0 +1,19 @@
+#ifndef _PARTICLE_BITSET_
+#define _PARTICLE_BITSET_
+
+#include "ShaderCommon.h"
+
+// Occupancy bitset used instead of the dead list by bitset pools.
+// One bit per slot (set = live) in 32-bit words, two words per 64-slot
+// block, plus one summary bit per block (set = block full), 32 blocks
+// to a summary word.
+#define BITSET_BLOCK_SLOTS		64
+#define BITSET_WORD_BITS		32
+#define BITSET_WORDS_PER_BLOCK	(BITSET_BLOCK_SLOTS / BITSET_WORD_BITS)
+
+// Per-dispatch counters of the bitset emitter pass
+#define BITSET_COUNTER_RESERVED	0	// spawns claimed by blocks so far
+#define BITSET_COUNTER_DONE		1	// blocks that finished the pass
+#define BITSET_COUNTER_COUNT	2
+
+#endif
\ No newline at end of file
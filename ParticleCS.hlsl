@@ -1,4 +1,12 @@
 #include "Particle.h"
+#include "ParticleBitset.h"
+#include "ParticleFeatures.h"
+#include "ParticleParams.hlsli"
+#include "ParticleModules.hlsli"
+
+#ifndef PARTICLE_FEATURES
+#define PARTICLE_FEATURES 0
+#endif
 
 RWStructuredBuffer<Particle> particles : register(u0);
 
@@ -6,28 +14,103 @@ AppendStructuredBuffer<uint> deadList : register(u1);
 
 AppendStructuredBuffer<uint> drawList : register(u2);
 
+RWStructuredBuffer<uint> occupancy : register(u3);
+
+RWStructuredBuffer<uint> blockFull : register(u4);
+
+RWStructuredBuffer<ParticleEvent> events : register(u5);
+
+RWStructuredBuffer<uint> eventCount : register(u6);
+
 cbuffer Constants : register(b0)
 {
 	float	deltaTime;
 	uint	maxParticles;
-	uint2	_padding;
+	uint	ringStart;		// slots from here on are recycled by their emitter's ring
+	float	totalTime;
+	uint	spawnModules;	// module program lengths; the update
+	uint	updateModules;	// program follows the spawn one
+	uint	eventMask;		// (1 << PARTICLE_EVENT_*) bits to report
+	uint	eventCapacity;
+	float4	cullPlane;		// view depth of the last camera drawn with
+	float	cullPixelScale;
+	float	cullMinPixels;	// 0 = draw everything
 }
 
-[numthreads(1024, 1, 1)]
+void FreeSlot(uint pid)
+{
+	InterlockedAnd(occupancy[pid / BITSET_WORD_BITS], ~(1u << (pid % BITSET_WORD_BITS)));
+
+	uint block = pid / BITSET_BLOCK_SLOTS;
+	uint summaryBit = 1u << (block % BITSET_WORD_BITS);
+	if (blockFull[block / BITSET_WORD_BITS] & summaryBit)
+		InterlockedAnd(blockFull[block / BITSET_WORD_BITS], ~summaryBit);
+}
+
+// events past the buffer's capacity are only counted
+void PushEvent(uint type, uint pid, float3 position)
+{
+#if PARTICLE_FEATURES & PARTICLE_FEATURE_EVENTS
+	if (0 == (eventMask & (1u << type)))
+		return;
+
+	uint slot;
+	InterlockedAdd(eventCount[0], 1, slot);
+	if (slot < eventCapacity)
+	{
+		ParticleEvent e;
+		e.position = position;
+		e.type = type;
+		e.particle = pid;
+		e._padding = 0;
+		events[slot] = e;
+	}
+#endif
+}
+
+// built once per feature mask and group size, see the wrappers
+#ifndef PARTICLE_THREADS
+#define PARTICLE_THREADS 1024
+#endif
+
+[numthreads(PARTICLE_THREADS, 1, 1)]
 void main(uint3 DTid : SV_DispatchThreadID)
 {
-	if (DTid.x >= maxParticles || particles[DTid.x].velocity.w < 0.01)
+	if (DTid.x >= maxParticles)
+		return;
+
+	Particle p = particles[DTid.x];
+	if (!IsAlive(p))
 		return;
 
-	particles[DTid.x].position.w += deltaTime;
+	p.age += deltaTime;
 
-	if (particles[DTid.x].position.w > particles[DTid.x].velocity.w)
+	// the life time is read every frame, so changing it reaches live particles too
+	if (p.age > emitterParams[p.emitter].lifeTime)
 	{
-		particles[DTid.x].velocity.w = 0;
-		deadList.Append(DTid.x);
+		PushEvent(PARTICLE_EVENT_DEATH, DTid.x, p.position);
+		particles[DTid.x].emitter = PARTICLE_DEAD;
+		if (DTid.x < ringStart)
+		{
+#if PARTICLE_FEATURES & PARTICLE_FEATURE_BITSET
+			FreeSlot(DTid.x);
+#else
+			deadList.Append(DTid.x);
+#endif
+		}
 		return;
 	}
 
-	particles[DTid.x].position.xyz += particles[DTid.x].velocity.xyz * deltaTime;
-	drawList.Append(DTid.x);
+#if PARTICLE_FEATURES & PARTICLE_FEATURE_MODULES
+	uint moduleEvents = RunModules(p, spawnModules, updateModules, deltaTime, totalTime);
+	if (moduleEvents & (1u << PARTICLE_EVENT_COLLIDE))
+		PushEvent(PARTICLE_EVENT_COLLIDE, DTid.x, p.position);
+#endif
+
+	IntegrateParticle(p, deltaTime);
+	particles[DTid.x] = p;
+
+	// too small to see: still simulated, just not drawn
+	if (!IsCulled(p, cullPlane, cullPixelScale, cullMinPixels))
+		drawList.Append(DTid.x);
 }
\ No newline at end of file
@@ -0,0 +1,3 @@
+#define PARTICLE_FEATURES PARTICLE_FEATURE_MODULES
+#define PARTICLE_THREADS 64
+#include "ParticleCS.hlsl"
\ No newline at end of file
@@ -0,0 +1,3 @@
+#define PARTICLE_FEATURES (PARTICLE_FEATURE_MODULES | PARTICLE_FEATURE_BITSET)
+#define PARTICLE_THREADS 64
+#include "ParticleCS.hlsl"
\ No newline at end of file
@@ -0,0 +1,2 @@
+#define PARTICLE_FEATURES (PARTICLE_FEATURE_MODULES | PARTICLE_FEATURE_EVENTS)
+#include "ParticleCS.hlsl"
\ No newline at end of file
@@ -0,0 +1,23 @@
+RWByteAddressBuffer drawArgs : register(u0);
+
+cbuffer Constants : register(b0)
+{
+	uint	regionCount;
+	uint	regionStride;		// PARTICLE_DRAW_ARGS_STRIDE
+	uint	vertexArgsOffset;	// PARTICLE_DRAW_VERTEX_ARGS_OFFSET
+	uint	_padding;
+}
+
+// Turns every pool's indexed args into the non-indexed ones the vertex-id
+// and expanded strategies draw with: IndexCountPerInstance * InstanceCount
+// vertices in a single instance
+[numthreads(64, 1, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+	if (DTid.x >= regionCount)
+		return;
+
+	uint offset = DTid.x * regionStride;
+	uint vertexCount = drawArgs.Load(offset) * drawArgs.Load(offset + 4);
+	drawArgs.Store4(offset + vertexArgsOffset, uint4(vertexCount, 1, 0, 0));
+}
\ No newline at end of file
@@ -3,43 +3,200 @@
 #include "ParticlePool.h"
 #include "ParticleSystem.h"
 
+#include <cassert>
+
 ParticleEmitter::ParticleEmitter(ParticleSystem * ps, uint32_t poolIdx, uint32_t emitterIdx)
 	:
 	ps(ps),
 	poolIdx(poolIdx),
-	emitterIdx(emitterIdx)
+	emitterIdx(emitterIdx),
+	texture(0),
+	frame(0, 0, 1, 1)
 {
-	auto& pool = ps->pools[poolIdx];
-	auto& emitter = pool.emitters[emitterIdx];
+	for (uint32_t i = 0; i < ps->pools[poolIdx].chunkCount; ++i)
+	{
+		auto& pool = ps->pools[poolIdx + i];
+		auto& emitter = pool.emitters[emitterIdx];
+
+		// shards interleave their spawns, see ParticleSystem::SetShard
+		emitter.counter = (float)ps->shardIndex / ps->shardCount;
+		emitter.deadParticles = 0;
+		emitter.emitCount = 0;
+		emitter.emitRate = 0.0f;
+		emitter.position = DirectX::XMFLOAT4();
+		emitter.velocity = DirectX::XMFLOAT4();
+		emitter.totalTime = 0.0f;
+		emitter.priority = 0;
+		emitter.ringBase = 0;
+		emitter.ringSize = 0;
+		emitter.ringHead = 0;
+		emitter.emitterIndex = emitterIdx;
+		emitter.prewarmAge = 0.0f;
+		emitter.prewarmPending = 0.0f;
 
-	emitter.counter = 0.0f;
-	emitter.deadParticles = 0;
-	emitter.emitCount = 0;
-	emitter.emitRate = 0.0f;
-	emitter.position = DirectX::XMFLOAT4();
-	emitter.velocity = DirectX::XMFLOAT4();
-	emitter.totalTime = 0.0f;
+		auto& params = pool.emitterParams[emitterIdx];
+		params.gravity = DirectX::XMFLOAT3();
+		params.lifeTime = 0.0f;
+		params.color = DirectX::XMFLOAT4(1, 1, 1, 1);
+		params.uvRect = DirectX::XMFLOAT4(0, 0, 1, 1);
+		params.drag = 0.0f;
+		params.size = 1.0f;
+		params.sizeEnd = 1.0f;
+		params.flags = 0;
+		pool.emitterParamsDirty = true;
 
+		DirectX::XMStoreFloat4x4(&pool.emitterTransforms[emitterIdx], DirectX::XMMatrixIdentity());
+		pool.emitterTransformsDirty = true;
+	}
 }
 
 void ParticleEmitter::SetParameters(DirectX::XMFLOAT3 & position, DirectX::XMFLOAT3 & velocity, float lifeTime, float emitRate)
 {
-	auto& pool = ps->pools[poolIdx];
-	auto& emitter = pool.emitters[emitterIdx];
-	
-	emitter.position = DirectX::XMFLOAT4(
-		position.x,
-		position.y,
-		position.z,
-		0
-	);
-
-	emitter.velocity = DirectX::XMFLOAT4(
-		velocity.x,
-		velocity.y,
-		velocity.z,
-		lifeTime
-	);
-
-	emitter.emitRate = emitRate;
+	for (uint32_t i = 0; i < ps->pools[poolIdx].chunkCount; ++i)
+	{
+		auto& pool = ps->pools[poolIdx + i];
+		auto& emitter = pool.emitters[emitterIdx];
+
+		emitter.position = DirectX::XMFLOAT4(
+			position.x,
+			position.y,
+			position.z,
+			0
+		);
+
+		emitter.velocity = DirectX::XMFLOAT4(
+			velocity.x,
+			velocity.y,
+			velocity.z,
+			0
+		);
+
+		emitter.emitRate = emitRate * pool.chunkShare / ps->shardCount;
+
+		// set every frame by most callers, so only upload actual changes
+		auto& params = pool.emitterParams[emitterIdx];
+		if (params.lifeTime != lifeTime)
+		{
+			params.lifeTime = lifeTime;
+			pool.emitterParamsDirty = true;
+		}
+	}
+}
+
+void ParticleEmitter::SetForces(const DirectX::XMFLOAT3 & gravity, float drag)
+{
+	for (uint32_t i = 0; i < ps->pools[poolIdx].chunkCount; ++i)
+	{
+		auto& pool = ps->pools[poolIdx + i];
+		auto& params = pool.emitterParams[emitterIdx];
+
+		params.gravity = gravity;
+		params.drag = drag;
+		pool.emitterParamsDirty = true;
+	}
+}
+
+void ParticleEmitter::SetAppearance(const DirectX::XMFLOAT4 & color, float size, const DirectX::XMFLOAT4 & uvRect)
+{
+	for (uint32_t i = 0; i < ps->pools[poolIdx].chunkCount; ++i)
+	{
+		auto& pool = ps->pools[poolIdx + i];
+		auto& params = pool.emitterParams[emitterIdx];
+
+		params.color = color;
+		params.size = size;
+		params.sizeEnd = size;
+		pool.emitterParamsDirty = true;
+	}
+
+	frame = uvRect;
+	UpdateUvRect();
+}
+
+void ParticleEmitter::SetSize(float birth, float death)
+{
+	for (uint32_t i = 0; i < ps->pools[poolIdx].chunkCount; ++i)
+	{
+		auto& pool = ps->pools[poolIdx + i];
+		auto& params = pool.emitterParams[emitterIdx];
+
+		params.size = birth;
+		params.sizeEnd = death;
+		pool.emitterParamsDirty = true;
+	}
+}
+
+void ParticleEmitter::SetTexture(uint32_t texture)
+{
+	assert(texture < max(ps->pools[poolIdx].atlasRects.size(), 1u));
+
+	this->texture = texture;
+	UpdateUvRect();
+}
+
+void ParticleEmitter::UpdateUvRect()
+{
+	// the frame is relative to the texture's rect in the atlas, if any
+	DirectX::XMFLOAT4 uvRect = frame;
+	const auto& atlasRects = ps->pools[poolIdx].atlasRects;
+	if (texture < atlasRects.size())
+	{
+		const DirectX::XMFLOAT4& rect = atlasRects[texture];
+		uvRect = DirectX::XMFLOAT4(rect.x + frame.x * rect.z, rect.y + frame.y * rect.w, frame.z * rect.z, frame.w * rect.w);
+	}
+
+	for (uint32_t i = 0; i < ps->pools[poolIdx].chunkCount; ++i)
+	{
+		auto& pool = ps->pools[poolIdx + i];
+		pool.emitterParams[emitterIdx].uvRect = uvRect;
+		pool.emitterParamsDirty = true;
+	}
+}
+
+void ParticleEmitter::SetPriority(int priority)
+{
+	for (uint32_t i = 0; i < ps->pools[poolIdx].chunkCount; ++i)
+	{
+		auto& pool = ps->pools[poolIdx + i];
+		auto& emitter = pool.emitters[emitterIdx];
+
+		emitter.priority = priority;
+		pool.emitOrderDirty = true;
+	}
+}
+
+
+void ParticleEmitter::SetLocalSpace(bool localSpace)
+{
+	for (uint32_t i = 0; i < ps->pools[poolIdx].chunkCount; ++i)
+	{
+		auto& pool = ps->pools[poolIdx + i];
+		auto& params = pool.emitterParams[emitterIdx];
+
+		params.flags = localSpace ? (params.flags | EMITTER_FLAG_LOCAL_SPACE) : (params.flags & ~EMITTER_FLAG_LOCAL_SPACE);
+		pool.emitterParamsDirty = true;
+	}
+}
+
+void ParticleEmitter::SetTransform(const DirectX::XMFLOAT4X4 & world)
+{
+	for (uint32_t i = 0; i < ps->pools[poolIdx].chunkCount; ++i)
+	{
+		auto& pool = ps->pools[poolIdx + i];
+
+		pool.emitterTransforms[emitterIdx] = world;
+		pool.emitterTransformsDirty = true;
+	}
+}
+
+void ParticleEmitter::Prewarm(float seconds)
+{
+	for (uint32_t i = 0; i < ps->pools[poolIdx].chunkCount; ++i)
+	{
+		auto& pool = ps->pools[poolIdx + i];
+		auto& emitter = pool.emitters[emitterIdx];
+
+		// particles spawned longer ago than that would already be dead
+		emitter.prewarmPending = min(seconds, pool.emitterParams[emitterIdx].lifeTime);
+	}
 }
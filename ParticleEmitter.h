@@ -15,7 +15,52 @@ private:
 	uint32_t poolIdx;
 	uint32_t emitterIdx;
 
+	uint32_t texture;				// in the pool's atlas
+	DirectX::XMFLOAT4 frame;		// uv rect given to SetAppearance, within the texture
+
+	void UpdateUvRect();
+
 
 public:
 	void SetParameters(DirectX::XMFLOAT3 & position, DirectX::XMFLOAT3 & velocity, float lifeTime, float emitRate);
+
+	// Applied to this emitter's live particles too, every frame after the call.
+	// drag is the fraction of the speed lost per second
+	void SetForces(const DirectX::XMFLOAT3 & gravity, float drag);
+
+	// Tint multiplied into the texture, world size of the quad, and the
+	// texture frame to draw as (offset xy, scale zw)
+	void SetAppearance(const DirectX::XMFLOAT4 & color, float size, const DirectX::XMFLOAT4 & uvRect);
+
+	// World size of the quad when a particle is born and when it dies, in
+	// between it grows or shrinks with the particle's age. SetAppearance
+	// sets both to its size
+	void SetSize(float birth, float death);
+
+	// Which texture of an atlas pool to draw, by its place in the list given
+	// to ParticleSystem::CreateAtlasPool. The uvRect of SetAppearance is then
+	// within that texture
+	void SetTexture(uint32_t texture);
+
+	// Simulate this emitter's particles relative to its transform, which the
+	// vertex shader applies when drawing, so moving the emitter moves them
+	// all without touching the particles. Position, velocity and forces are
+	// then in the emitter's space, and so are its event positions. Switching
+	// with particles alive makes them jump
+	void SetLocalSpace(bool localSpace);
+
+	// World matrix of a local-space emitter, transposed for HLSL like
+	// Entity::GetWorldMatrix returns it
+	void SetTransform(const DirectX::XMFLOAT4X4 & world);
+
+	// Fills in the particles the emitter would have alive had it already run
+	// for this long at its current settings, in one batch on the next
+	// update instead of its usual spawns. Call it after SetParameters
+	void Prewarm(float seconds);
+
+	// Only matters in pools created with OVERFLOW_STEAL: spawns that find
+	// the dead list empty overwrite live particles of emitters with a lower
+	// priority, and emitters of the same priority never take from each
+	// other. Higher-priority emitters spawn first
+	void SetPriority(int priority);
 };
\ No newline at end of file
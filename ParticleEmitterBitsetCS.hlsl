@@ -0,0 +1,100 @@
+#include "Particle.h"
+#include "Emitter.h"
+#include "ParticleBitset.h"
+#include "ParticleSpawn.hlsli"
+
+RWStructuredBuffer<Particle> particles : register(u0);
+RWStructuredBuffer<uint> occupancy : register(u1);
+RWStructuredBuffer<uint> stats : register(u2);
+RWStructuredBuffer<uint> blockFull : register(u3);
+RWStructuredBuffer<uint> counters : register(u4);
+
+cbuffer Pool : register(b1)
+{
+	uint	ringStart;		// slots [0, ringStart) belong to the bitset
+	uint	blockCount;		// blocks covering [0, ringStart)
+	uint	spawnModules;	// length of the spawn module program
+	uint	updateModules;	// length of the update module program, for prewarms
+}
+
+// bits of the word starting at slot `first` that lie past the bitset range
+uint OutOfRange(uint first)
+{
+	if (first >= ringStart)
+		return 0xffffffff;
+
+	uint n = ringStart - first;
+	return n >= BITSET_WORD_BITS ? 0 : (0xffffffff << n);
+}
+
+// One thread per 64-slot block. Each block claims as many spawns as it has
+// free slots with a single atomic, then fills them without touching any
+// other thread's words.
+[numthreads(64, 1, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+	uint block = DTid.x;
+	if (block >= blockCount)
+		return;
+
+	uint summaryBit = 1u << (block % BITSET_WORD_BITS);
+	if ((blockFull[block / BITSET_WORD_BITS] & summaryBit) == 0)
+	{
+		uint first = block * BITSET_WORDS_PER_BLOCK;
+		uint firstSlot = block * BITSET_BLOCK_SLOTS;
+		uint2 used = uint2(
+			occupancy[first] | OutOfRange(firstSlot),
+			occupancy[first + 1] | OutOfRange(firstSlot + BITSET_WORD_BITS));
+
+		uint free = countbits(~used.x) + countbits(~used.y);
+
+		uint reserved;
+		InterlockedAdd(counters[BITSET_COUNTER_RESERVED], free, reserved);
+
+		if (reserved < emitCount)
+		{
+			uint count = min(free, emitCount - reserved);
+			for (uint i = 0; i < count; ++i)
+			{
+				uint pid;
+				if (used.x != 0xffffffff)
+				{
+					uint bit = firstbitlow(~used.x);
+					used.x |= 1u << bit;
+					pid = firstSlot + bit;
+				}
+				else
+				{
+					uint bit = firstbitlow(~used.y);
+					used.y |= 1u << bit;
+					pid = firstSlot + BITSET_WORD_BITS + bit;
+				}
+
+				Particle p = SpawnParticle(position.xyz, velocity.xyz, emitterIndex, totalTime, spawnModules);
+				if (prewarmAge > 0)
+					PrewarmParticle(p, prewarmAge * (1.0 - (reserved + i + 0.5) / emitCount), totalTime, spawnModules, updateModules);
+				particles[pid] = p;
+			}
+
+			occupancy[first] = used.x;
+			occupancy[first + 1] = used.y;
+
+			if (used.x == 0xffffffff && used.y == 0xffffffff)
+				InterlockedOr(blockFull[block / BITSET_WORD_BITS], summaryBit);
+		}
+	}
+
+	// the last block to finish sees the final reservation total; anything
+	// the whole pool couldn't cover was dropped
+	DeviceMemoryBarrier();
+
+	uint done;
+	InterlockedAdd(counters[BITSET_COUNTER_DONE], 1, done);
+	if (done == blockCount - 1)
+	{
+		uint total;
+		InterlockedAdd(counters[BITSET_COUNTER_RESERVED], 0, total);
+		if (total < emitCount)
+			InterlockedAdd(stats[PARTICLE_STAT_DROPPED], emitCount - total);
+	}
+}
@@ -1,23 +1,82 @@
 #include "Particle.h"
 #include "Emitter.h"
-#include "Noise.hlsli"
+#include "ParticleRecycle.h"
+#include "ParticleSpawn.hlsli"
 
 RWStructuredBuffer<Particle> particles : register(u0);
-
 ConsumeStructuredBuffer<uint> deadList : register(u1);
+RWStructuredBuffer<uint> stats : register(u2);
+RWStructuredBuffer<uint> recycleCounters : register(u3);
+
+StructuredBuffer<uint> victims : register(t0);	// see ParticleRecycleCollectCS
 
-[numthreads(1024, 1, 1)]
+cbuffer Pool : register(b1)
+{
+	uint	overflowPolicy;
+	uint	spawnModules;	// length of the spawn module program
+	uint	stateless;		// store the spawn time instead of an age
+	uint	updateModules;	// length of the update module program, for prewarms
+	uint	stealRank;		// OVERFLOW_STEAL: this emitter's priority rank, see ParticleRecycle.h
+}
+
+// built once per group size, see the <Kernel><threads>.hlsl wrappers
+#ifndef PARTICLE_THREADS
+#define PARTICLE_THREADS 1024
+#endif
+
+[numthreads(PARTICLE_THREADS, 1, 1)]
 void main(uint3 DTid : SV_DispatchThreadID)
 {
-	if (DTid.x < deadParticles && DTid.x < emitCount)
+	if (DTid.x >= emitCount)
+		return;
+
+	uint pid;
+	if (ringSize > 0)
 	{
-		uint pid = deadList.Consume();
+		// lifetimes within an emitter are uniform, so its particles die in the
+		// order they were born and the ring head always lands on the oldest
+		pid = ringBase + (ringHead + DTid.x) % ringSize;
+	}
+	else if (DTid.x < deadParticles)
+	{
+		pid = deadList.Consume();
+	}
+	else
+	{
+		// the victims were live before this frame's first spawn, so none of
+		// them is a slot another spawn just took from the dead list
+		uint victim = 0;
+		uint victimCount = 0;
+		if (overflowPolicy == OVERFLOW_RECYCLE || overflowPolicy == OVERFLOW_STEAL)
+		{
+			InterlockedAdd(recycleCounters[RECYCLE_COUNTER_CLAIMED], 1, victim);
+			victimCount = recycleCounters[RECYCLE_COUNTER_VICTIMS];
+		}
 
-		particles[pid].position = position;
+		// higher ranks spawn first and the list is sorted by rank, so the
+		// claims of lower ranks can only ever fail once these have
+		if (overflowPolicy == OVERFLOW_STEAL)
+			victimCount = stealRank > 0 ? min(victimCount, recycleCounters[stealRank - 1]) : 0;
 
-		float3 randomFloat = curlNoise3D(particles[pid].position.xyz, totalTime);
-		particles[pid].position.xz += (randomFloat.xz % 10) / 100;
+		if (victim >= victimCount)
+		{
+			InterlockedAdd(stats[PARTICLE_STAT_DROPPED], 1);
+			return;
+		}
 
-		particles[pid].velocity = velocity;
+		pid = victims[victim];
+		InterlockedAdd(stats[overflowPolicy == OVERFLOW_STEAL ? PARTICLE_STAT_STOLEN : PARTICLE_STAT_RECYCLED], 1);
 	}
+
+	Particle p = SpawnParticle(position.xyz, velocity.xyz, emitterIndex, totalTime, spawnModules);
+
+	// a prewarm spreads its spawns over the ages, oldest first so that
+	// rings still overwrite the oldest particles first
+	float age = prewarmAge * (1.0 - (DTid.x + 0.5) / emitCount);
+	if (stateless)
+		p.age = totalTime - age;
+	else if (age > 0)
+		PrewarmParticle(p, age, totalTime, spawnModules, updateModules);
+
+	particles[pid] = p;
 }
@@ -0,0 +1,2 @@
+#define PARTICLE_THREADS 256
+#include "ParticleEmitterCS.hlsl"
\ No newline at end of file
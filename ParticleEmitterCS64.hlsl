@@ -0,0 +1,2 @@
+#define PARTICLE_THREADS 64
+#include "ParticleEmitterCS.hlsl"
\ No newline at end of file
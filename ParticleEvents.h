@@ -0,0 +1,24 @@
+#ifndef _PARTICLE_EVENTS_
+#define _PARTICLE_EVENTS_
+
+#include "ShaderCommon.h"
+
+// Event types written by the simulate pass
+#define PARTICLE_EVENT_DEATH		0	// reached the end of its life time
+#define PARTICLE_EVENT_COLLIDE		1	// bounced off a collision module's plane
+
+#define PARTICLE_EVENT_MASK_ALL		0xFFFFFFFF
+
+// Staging buffers per pool, so the CPU reads events this many frames late
+// and never waits on the GPU
+#define PARTICLE_EVENT_READBACK_FRAMES	3
+
+struct ParticleEvent
+{
+	float3		position;
+	uint		type;		// PARTICLE_EVENT_*
+	uint		particle;	// slot in the pool, counted across its chunks
+	uint		_padding;
+};
+
+#endif
\ No newline at end of file
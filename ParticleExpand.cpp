@@ -0,0 +1,68 @@
+#include "ParticleExpand.h"
+
+using namespace DirectX;
+
+// mirrors ParticleCorner in ParticleQuad.hlsli, for non-instanced pools
+static void ParticleCorner(const ParticleExpandInput & input, uint32_t index, uint32_t corner, ParticleVertex & vertex)
+{
+	vertex = ParticleVertex();
+
+	uint32_t pid = nullptr != input.drawList ? input.drawList[index] : index;
+	const Particle& particle = input.particles[pid];
+
+	if (nullptr == input.drawList && particle.emitter == PARTICLE_DEAD)
+		return;
+
+	const EmitterParams& params = input.emitterParams[particle.emitter];
+
+	XMVECTOR position = XMLoadFloat3(&particle.position);
+	float age = particle.age;
+	if (input.stateless)
+	{
+		age = input.totalTime - particle.age;
+		if (age > params.lifeTime)
+			return;
+
+		position += XMLoadFloat3(&particle.velocity) * age + XMLoadFloat3(&params.gravity) * (0.5f * age * age);
+	}
+
+	XMVECTOR pos = XMVectorSetW(position, 1.0f);
+
+	if (params.flags & EMITTER_FLAG_LOCAL_SPACE)
+		pos = XMVector4Transform(pos, XMMatrixTranspose(XMLoadFloat4x4(&input.emitterTransforms[particle.emitter])));
+
+	pos = XMVector4Transform(pos, XMMatrixTranspose(XMLoadFloat4x4(&input.view)));
+
+	// ParticleSize and IsSubPixel in ParticleSize.hlsli
+	float t = min(max(age / params.lifeTime, 0.0f), 1.0f);
+	float size = params.size + (params.sizeEnd - params.size) * t;
+	float depth = XMVectorGetZ(pos);
+	if (input.minPixels > 0.0f && depth > 0.0f && size * input.pixelScale < input.minPixels * depth)
+		return;
+
+	if (input.maxPixels > 0.0f && depth > 0.0f)
+		size = min(size, input.maxPixels * depth / input.pixelScale);
+
+	float u = (float)(corner % 2);
+	float v = (float)(corner / 2);
+	pos += XMVectorSet((u - 0.5f) * size, (v - 0.5f) * size, 0.0f, 0.0f);
+
+	XMStoreFloat4(&vertex.position, XMVector4Transform(pos, XMMatrixTranspose(XMLoadFloat4x4(&input.projection))));
+	vertex.texcoord = XMFLOAT2(params.uvRect.x + u * params.uvRect.z, params.uvRect.y + v * params.uvRect.w);
+	vertex.color = params.color;
+}
+
+void ExpandParticleQuads(const ParticleExpandInput & input, ParticleVertex * vertices)
+{
+	static const uint32_t quadCorners[6] = { 0, 2, 3, 0, 3, 1 };
+
+	for (uint32_t i = 0; i < input.count; ++i)
+	{
+		ParticleVertex corners[4];
+		for (uint32_t c = 0; c < 4; ++c)
+			ParticleCorner(input, i, c, corners[c]);
+
+		for (uint32_t v = 0; v < 6; ++v)
+			vertices[i * 6 + v] = corners[quadCorners[v]];
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <DirectXMath.h>
+
+#include <cstdint>
+
+#include "Particle.h"
+#include "EmitterParams.h"
+#include "ParticleVertex.h"
+
+// What ExpandParticleQuads reads, laid out as the GPU has it. Matrices are
+// transposed for HLSL, the way ParticleSystem::Draw takes them
+struct ParticleExpandInput
+{
+	const Particle*					particles;
+	const uint32_t*					drawList;			// null: every slot, the way stateless pools are drawn
+	uint32_t						count;				// particles drawn
+	const EmitterParams*			emitterParams;
+	const DirectX::XMFLOAT4X4*		emitterTransforms;
+	bool							stateless;			// positions evaluated from spawn time, see ParticlePoolDesc
+	float							totalTime;
+	DirectX::XMFLOAT4X4				view;
+	DirectX::XMFLOAT4X4				projection;
+	float							pixelScale;			// see ParticleSystem::SetScreenSizeLimits
+	float							minPixels;			// 0 = no limit
+	float							maxPixels;			// 0 = no limit
+};
+
+// CPU version of ParticleExpandCS, to check its output or expand without a
+// device. Writes six vertices per particle, input.count * 6 in all, in the
+// order the GPU does
+void ExpandParticleQuads(const ParticleExpandInput& input, ParticleVertex* vertices);
\ No newline at end of file
@@ -0,0 +1,39 @@
+#include "ParticleQuad.hlsli"
+#include "ParticleVertex.h"
+
+RWStructuredBuffer<ParticleVertex> vertices : register(u0);
+
+// the draw args, where the pool's draw list count was copied to
+RWByteAddressBuffer drawArgs : register(u1);
+
+cbuffer ExpandConstants : register(b2)
+{
+	uint	drawArgsOffset;
+	uint	slotCount;		// quads to expand when allSlots
+	uint2	_padding;
+}
+
+// Writes out the six vertices of every drawn particle's quad, for pools
+// drawn with PARTICLE_DRAW_EXPANDED. Never used on instanced pools
+[numthreads(256, 1, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+	uint count = allSlots ? slotCount : drawArgs.Load(drawArgsOffset + 4);
+	if (DTid.x >= count)
+		return;
+
+	V2F corners[4];
+	for (uint c = 0; c < 4; ++c)
+		corners[c] = ParticleCorner(DTid.x, 0, c);
+
+	for (uint v = 0; v < 6; ++v)
+	{
+		V2F corner = corners[QUAD_CORNERS[v]];
+
+		ParticleVertex vertex;
+		vertex.position = corner.position;
+		vertex.color = corner.color;
+		vertex.texcoord = corner.texcoord;
+		vertices[DTid.x * 6 + v] = vertex;
+	}
+}
\ No newline at end of file
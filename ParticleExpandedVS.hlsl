@@ -0,0 +1,23 @@
+#include "ParticleVertex.h"
+
+// written by ParticleExpandCS
+StructuredBuffer<ParticleVertex> vertices : register(t0);
+
+struct V2F
+{
+	float4 position : SV_POSITION;
+	float2 texcoord : TEXCOORD0;
+	float4 color : COLOR0;
+};
+
+V2F main(uint vid : SV_VertexID)
+{
+	ParticleVertex vertex = vertices[vid];
+
+	V2F output;
+	output.position = vertex.position;
+	output.texcoord = vertex.texcoord;
+	output.color = vertex.color;
+
+	return output;
+}
\ No newline at end of file
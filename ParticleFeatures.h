@@ -0,0 +1,14 @@
+#ifndef _PARTICLE_FEATURES_
+#define _PARTICLE_FEATURES_
+
+#include "ShaderCommon.h"
+
+// Optional features of the simulate kernel. Each combination is compiled
+// ahead of time from a ParticleCS<features><threads>.hlsl wrapper that
+// defines PARTICLE_FEATURES, so a pool only pays for what it uses.
+#define PARTICLE_FEATURE_MODULES	1	// run the pool's update module program
+#define PARTICLE_FEATURE_BITSET		2	// free slots in the occupancy bitset instead of the dead list
+#define PARTICLE_FEATURE_EVENTS		4	// write death and collision events for readback
+#define PARTICLE_FEATURE_MASKS		8
+
+#endif
\ No newline at end of file
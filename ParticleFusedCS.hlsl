@@ -0,0 +1,145 @@
+#include "Particle.h"
+#include "Emitter.h"
+#include "ParticleSpawn.hlsli"
+
+#define GROUP_SIZE 1024
+
+RWStructuredBuffer<Particle> particles : register(u0);
+AppendStructuredBuffer<uint> drawList : register(u1);
+RWStructuredBuffer<uint> stats : register(u2);
+RWStructuredBuffer<uint> counters : register(u3);
+
+StructuredBuffer<EmitterSpawn> spawns : register(t0);
+
+cbuffer Constants : register(b0)
+{
+	float	deltaTime;
+	float	totalTime;
+	uint	maxParticles;
+	uint	groupCount;
+	uint	spawnCount;		// entries in spawns
+	uint	totalEmitCount;	// sum of their emitCount
+	uint	spawnModules;	// module program lengths; the update
+	uint	updateModules;	// program follows the spawn one
+	float4	cullPlane;		// view depth of the last camera drawn with
+	float	cullPixelScale;
+	float	cullMinPixels;	// 0 = draw everything
+}
+
+groupshared uint gsNeeded;
+groupshared uint gsFirstTicket;
+
+// the spawn entry whose ticket range contains `ticket`
+EmitterSpawn FindSpawn(uint ticket)
+{
+	uint lo = 0;
+	uint hi = spawnCount - 1;
+	while (lo < hi)
+	{
+		uint mid = (lo + hi + 1) / 2;
+		if (spawns[mid].firstTicket <= ticket)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return spawns[lo];
+}
+
+// Emits and integrates in one sweep over the pool: live particles are moved
+// as in ParticleCS, and any slot that is dead (or dies this frame) takes a
+// ticket and is respawned in place, so no dead list is needed at all.
+[numthreads(GROUP_SIZE, 1, 1)]
+void main(uint3 DTid : SV_DispatchThreadID, uint GI : SV_GroupIndex)
+{
+	uint pid = DTid.x;
+
+	if (GI == 0)
+		gsNeeded = 0;
+	GroupMemoryBarrierWithGroupSync();
+
+	Particle p = (Particle)0;
+	bool alive = false;
+	bool changed = false;
+	uint localTicket = 0;
+
+	if (pid < maxParticles)
+	{
+		p = particles[pid];
+		alive = IsAlive(p);
+
+		if (alive)
+		{
+			p.age += deltaTime;
+			if (p.age > emitterParams[p.emitter].lifeTime)
+			{
+				p.emitter = PARTICLE_DEAD;
+				alive = false;
+			}
+			else
+			{
+				RunModules(p, spawnModules, updateModules, deltaTime, totalTime);
+				IntegrateParticle(p, deltaTime);
+			}
+			changed = true;
+		}
+
+		if (!alive && totalEmitCount > 0)
+			InterlockedAdd(gsNeeded, 1, localTicket);
+	}
+
+	// one global atomic per group hands out a run of tickets
+	GroupMemoryBarrierWithGroupSync();
+	if (GI == 0 && gsNeeded > 0)
+		InterlockedAdd(counters[FUSED_COUNTER_TICKETS], gsNeeded, gsFirstTicket);
+	GroupMemoryBarrierWithGroupSync();
+
+	if (pid < maxParticles && !alive && totalEmitCount > 0)
+	{
+		uint ticket = gsFirstTicket + localTicket;
+		if (ticket < totalEmitCount)
+		{
+			EmitterSpawn spawn = FindSpawn(ticket);
+			p = SpawnParticle(spawn.position.xyz, spawn.velocity.xyz, spawn.emitterIndex, totalTime, spawnModules);
+
+			// spread this frame's spawns evenly over the frame; each one only
+			// gets the part of the step that is left after it was born. A
+			// prewarm spreads them over its whole span the same way
+			float born = ((ticket - spawn.firstTicket) + 0.5) / spawn.emitCount;
+			if (spawn.prewarmAge > 0)
+			{
+				PrewarmParticle(p, spawn.prewarmAge * (1.0 - born), totalTime, spawnModules, updateModules);
+			}
+			else
+			{
+				float remaining = deltaTime * (1.0 - born);
+				p.age = remaining;
+				IntegrateParticle(p, remaining);
+			}
+
+			alive = true;
+			changed = true;
+		}
+	}
+
+	if (changed)
+		particles[pid] = p;
+
+	if (alive && !IsCulled(p, cullPlane, cullPixelScale, cullMinPixels))
+		drawList.Append(pid);
+
+	// the last group to finish sees how many dead slots there were in total
+	if (GI == 0)
+	{
+		DeviceMemoryBarrier();
+
+		uint done;
+		InterlockedAdd(counters[FUSED_COUNTER_GROUPS_DONE], 1, done);
+		if (done == groupCount - 1)
+		{
+			uint tickets;
+			InterlockedAdd(counters[FUSED_COUNTER_TICKETS], 0, tickets);
+			if (tickets < totalEmitCount)
+				InterlockedAdd(stats[PARTICLE_STAT_DROPPED], totalEmitCount - tickets);
+		}
+	}
+}
@@ -6,7 +6,8 @@ RWStructuredBuffer<uint> deadList : register(u1);
 [numthreads(1024, 1, 1)]
 void main( uint3 DTid : SV_DispatchThreadID )
 {
-	particles[DTid.x].position = float4(0, 0, 0, 0);
-	particles[DTid.x].velocity = float4(0, 0, 0, 0);
+	Particle p = (Particle)0;
+	p.emitter = PARTICLE_DEAD;
+	particles[DTid.x] = p;
 	deadList[DTid.x] = DTid.x;
 }
\ No newline at end of file
@@ -0,0 +1,17 @@
+#ifndef _PARTICLE_INSTANCE_
+#define _PARTICLE_INSTANCE_
+
+#include "ShaderCommon.h"
+
+// Copies an instanced pool can draw of its one simulated particle set
+#define MAX_PARTICLE_INSTANCES	256
+
+// One drawn copy of an instanced pool
+struct ParticleInstance
+{
+	float4x4	transform;	// world matrix, transposed for HLSL like Entity::GetWorldMatrix
+	float		timeOffset;	// seconds this copy runs ahead of the simulated set, >= 0
+	float3		_padding;
+};
+
+#endif
\ No newline at end of file
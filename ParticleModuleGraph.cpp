@@ -0,0 +1,417 @@
+#include "ParticleModuleGraph.h"
+
+#include "ParticleEvents.h"
+#include "ParticleModules.h"
+
+#include <cmath>
+#include <cstring>
+
+#include <sstream>
+
+using namespace DirectX;
+
+namespace
+{
+	// appends instructions and constants for one stage
+	struct Assembler
+	{
+		ParticleProgram& program;
+
+		uint32_t Const(float x, float y, float z, float w)
+		{
+			program.constants.push_back(XMFLOAT4(x, y, z, w));
+			return program.constants.size() - 1;
+		}
+
+		void Op(uint32_t op, uint32_t dst, uint32_t a, uint32_t b = 0)
+		{
+			program.code.push_back(XMUINT4(op, dst, a, b));
+		}
+	};
+
+	const uint32_t P = MODULE_REG_POSITION;
+	const uint32_t V = MODULE_REG_VELOCITY;
+	const uint32_t T = MODULE_REG_TIME;
+	const uint32_t R3 = MODULE_REG_TEMP;
+	const uint32_t R4 = MODULE_REG_TEMP + 1;
+	const uint32_t R5 = MODULE_REG_TEMP + 2;
+
+	void Assemble(Assembler& as, const ParticleModule& module)
+	{
+		const XMFLOAT4& p = module.params;
+
+		// constants that touch the velocity keep w at 0 (or 1 for factors)
+		// so the life time in the velocity register is left alone
+		switch (module.type)
+		{
+		case PARTICLE_MODULE_ADD_VELOCITY:
+			as.Op(MODULE_OP_CONST, R3, as.Const(p.x, p.y, p.z, 0));
+			as.Op(MODULE_OP_ADD, V, V, R3);
+			break;
+
+		case PARTICLE_MODULE_ADD_FORCE:
+			as.Op(MODULE_OP_CONST, R3, as.Const(p.x, p.y, p.z, 0));
+			as.Op(MODULE_OP_SPLAT, R4, T, 0);
+			as.Op(MODULE_OP_MAD, V, R3, R4);
+			break;
+
+		case PARTICLE_MODULE_DRAG:
+			// v *= saturate(1 - drag * dt)
+			as.Op(MODULE_OP_CONST, R3, as.Const(p.x, p.x, p.x, 0));
+			as.Op(MODULE_OP_SPLAT, R4, T, 0);
+			as.Op(MODULE_OP_MUL, R3, R3, R4);
+			as.Op(MODULE_OP_CONST, R4, as.Const(1, 1, 1, 1));
+			as.Op(MODULE_OP_SUB, R4, R4, R3);
+			as.Op(MODULE_OP_SAT, R4, R4);
+			as.Op(MODULE_OP_MUL, V, V, R4);
+			break;
+
+		case PARTICLE_MODULE_SPEED_BY_AGE:
+			as.Op(MODULE_OP_CONST, R3, as.Const(p.x, p.x, p.x, 1));
+			as.Op(MODULE_OP_CONST, R4, as.Const(p.y, p.y, p.y, 1));
+			as.Op(MODULE_OP_SPLAT, R5, T, 1);
+			as.Op(MODULE_OP_MIX, R3, R4, R5);
+			as.Op(MODULE_OP_NRM3, R4, V);
+			as.Op(MODULE_OP_MUL, V, R4, R3);
+			break;
+
+		case PARTICLE_MODULE_COLLIDE_PLANE:
+			as.Op(MODULE_OP_CONST, R3, as.Const(p.x, p.y, p.z, p.w));
+			as.Op(MODULE_OP_CONST, R4, as.Const(module.extra.x, 0, 0, 0));
+			as.Op(MODULE_OP_COLLIDE, 0, R3, R4);
+			break;
+		}
+	}
+
+	// the VM indexes its registers and constants without checking them
+	bool IsValid(const XMUINT4& ins, size_t constantCount)
+	{
+		if (ins.x >= MODULE_OP_COUNT || ins.y >= MODULE_REGISTERS)
+			return false;
+
+		switch (ins.x)
+		{
+		case MODULE_OP_CONST:	return ins.z < constantCount;
+		case MODULE_OP_SPLAT:	return ins.z < MODULE_REGISTERS && ins.w < 4;
+		default:				return ins.z < MODULE_REGISTERS && ins.w < MODULE_REGISTERS;
+		}
+	}
+}
+
+void ParticleModuleGraph::Add(ParticleModuleStage stage, ParticleModuleType type, const XMFLOAT4 & params, const XMFLOAT4 & extra)
+{
+	ParticleModule module;
+	module.stage = stage;
+	module.type = type;
+	module.params = params;
+	module.extra = extra;
+	modules.push_back(module);
+}
+
+bool ParticleModuleGraph::Compile(ParticleProgram & program) const
+{
+	program.code.clear();
+	program.constants.clear();
+
+	Assembler as = { program };
+	for (uint32_t stage = 0; stage < PARTICLE_STAGE_COUNT; ++stage)
+	{
+		uint32_t start = program.code.size();
+		for (auto iModule = modules.begin(); iModule != modules.end(); ++iModule)
+		{
+			if (iModule->stage == stage)
+				Assemble(as, *iModule);
+		}
+		program.length[stage] = program.code.size() - start;
+	}
+
+	if (program.code.size() > MODULE_MAX_CODE || program.constants.size() > MODULE_MAX_CONSTANTS)
+		return false;
+
+	for (auto iIns = program.code.begin(); iIns != program.code.end(); ++iIns)
+	{
+		if (!IsValid(*iIns, program.constants.size()))
+			return false;
+	}
+
+	return true;
+}
+
+namespace
+{
+	// ParticleModuleGraph::Run over batches of B particles. Registers are
+	// component-major, so every component of an instruction is one B wide
+	// loop the compiler can vectorize
+	template <uint32_t B>
+	void RunBatched(const ParticleProgram& program, uint32_t start, uint32_t end, Particle* particles, uint32_t count,
+		const EmitterParams* emitterParams, float deltaTime, float totalTime, uint32_t* events)
+	{
+		for (uint32_t base = 0; base < count; base += B)
+		{
+			uint32_t lanes = count - base < B ? count - base : B;
+			Particle* batch = particles + base;
+
+			uint32_t laneEvents[B] = {};
+			if (start == end)
+			{
+				if (events)
+					memcpy(events + base, laneEvents, lanes * sizeof(uint32_t));
+				continue;
+			}
+
+			// lanes past the end and dead particles run on zeros and are
+			// never written back
+			float r[MODULE_REGISTERS][4][B] = {};
+			bool live[B] = {};
+			for (uint32_t l = 0; l < lanes; ++l)
+			{
+				const Particle& p = batch[l];
+				live[l] = p.emitter != PARTICLE_DEAD;
+				if (!live[l])
+					continue;
+
+				float lifeTime = emitterParams[p.emitter].lifeTime;
+				float used = lifeTime > 0 ? p.age / lifeTime : 0;
+				r[MODULE_REG_POSITION][0][l] = p.position.x;
+				r[MODULE_REG_POSITION][1][l] = p.position.y;
+				r[MODULE_REG_POSITION][2][l] = p.position.z;
+				r[MODULE_REG_POSITION][3][l] = p.age;
+				r[MODULE_REG_VELOCITY][0][l] = p.velocity.x;
+				r[MODULE_REG_VELOCITY][1][l] = p.velocity.y;
+				r[MODULE_REG_VELOCITY][2][l] = p.velocity.z;
+				r[MODULE_REG_VELOCITY][3][l] = lifeTime;
+				r[MODULE_REG_TIME][0][l] = deltaTime;
+				r[MODULE_REG_TIME][1][l] = used < 0 ? 0 : (used > 1 ? 1 : used);
+				r[MODULE_REG_TIME][2][l] = totalTime;
+			}
+
+			for (uint32_t pc = start; pc < end; ++pc)
+			{
+				const XMUINT4& ins = program.code[pc];
+				float (*d)[B] = r[ins.y];
+				const float (*a)[B] = r[ins.z < MODULE_REGISTERS ? ins.z : 0];
+				const float (*b)[B] = r[ins.w < MODULE_REGISTERS ? ins.w : 0];
+
+				switch (ins.x)
+				{
+				case MODULE_OP_CONST:
+				{
+					const XMFLOAT4& c = program.constants[ins.z];
+					for (uint32_t l = 0; l < B; ++l)
+					{
+						d[0][l] = c.x;
+						d[1][l] = c.y;
+						d[2][l] = c.z;
+						d[3][l] = c.w;
+					}
+					break;
+				}
+
+				case MODULE_OP_MOV:
+					for (uint32_t c = 0; c < 4; ++c)
+						for (uint32_t l = 0; l < B; ++l)
+							d[c][l] = a[c][l];
+					break;
+
+				case MODULE_OP_SPLAT:
+				{
+					float x[B];
+					for (uint32_t l = 0; l < B; ++l)
+						x[l] = a[ins.w][l];
+					for (uint32_t c = 0; c < 4; ++c)
+						for (uint32_t l = 0; l < B; ++l)
+							d[c][l] = x[l];
+					break;
+				}
+
+				case MODULE_OP_ADD:
+					for (uint32_t c = 0; c < 4; ++c)
+						for (uint32_t l = 0; l < B; ++l)
+							d[c][l] = a[c][l] + b[c][l];
+					break;
+
+				case MODULE_OP_SUB:
+					for (uint32_t c = 0; c < 4; ++c)
+						for (uint32_t l = 0; l < B; ++l)
+							d[c][l] = a[c][l] - b[c][l];
+					break;
+
+				case MODULE_OP_MUL:
+					for (uint32_t c = 0; c < 4; ++c)
+						for (uint32_t l = 0; l < B; ++l)
+							d[c][l] = a[c][l] * b[c][l];
+					break;
+
+				case MODULE_OP_MAD:
+					for (uint32_t c = 0; c < 4; ++c)
+						for (uint32_t l = 0; l < B; ++l)
+							d[c][l] += a[c][l] * b[c][l];
+					break;
+
+				case MODULE_OP_MIN:
+					for (uint32_t c = 0; c < 4; ++c)
+						for (uint32_t l = 0; l < B; ++l)
+							d[c][l] = a[c][l] < b[c][l] ? a[c][l] : b[c][l];
+					break;
+
+				case MODULE_OP_MAX:
+					for (uint32_t c = 0; c < 4; ++c)
+						for (uint32_t l = 0; l < B; ++l)
+							d[c][l] = a[c][l] > b[c][l] ? a[c][l] : b[c][l];
+					break;
+
+				case MODULE_OP_SAT:
+					for (uint32_t c = 0; c < 4; ++c)
+						for (uint32_t l = 0; l < B; ++l)
+							d[c][l] = a[c][l] < 0 ? 0 : (a[c][l] > 1 ? 1 : a[c][l]);
+					break;
+
+				case MODULE_OP_MIX:
+				{
+					float t[B];
+					for (uint32_t l = 0; l < B; ++l)
+						t[l] = b[0][l];
+					for (uint32_t c = 0; c < 4; ++c)
+						for (uint32_t l = 0; l < B; ++l)
+							d[c][l] += (a[c][l] - d[c][l]) * t[l];
+					break;
+				}
+
+				case MODULE_OP_NRM3:
+				{
+					// clamped like the shader, so a particle at rest keeps a zero
+					// velocity rather than a NaN one
+					float scale[B];
+					for (uint32_t l = 0; l < B; ++l)
+						scale[l] = 1 / sqrtf(max(a[0][l] * a[0][l] + a[1][l] * a[1][l] + a[2][l] * a[2][l], 1e-20f));
+					for (uint32_t c = 0; c < 4; ++c)
+						for (uint32_t l = 0; l < B; ++l)
+							d[c][l] = c < 3 ? a[c][l] * scale[l] : a[c][l];
+					break;
+				}
+
+				case MODULE_OP_COLLIDE:
+				{
+					float (*pos)[B] = r[MODULE_REG_POSITION];
+					float (*vel)[B] = r[MODULE_REG_VELOCITY];
+					for (uint32_t l = 0; l < B; ++l)
+					{
+						float depth = pos[0][l] * a[0][l] + pos[1][l] * a[1][l] + pos[2][l] * a[2][l] - a[3][l];
+						float approach = vel[0][l] * a[0][l] + vel[1][l] * a[1][l] + vel[2][l] * a[2][l];
+						if (depth < 0 && approach < 0)
+						{
+							float bounce = approach * (1 + b[0][l]);
+							for (uint32_t c = 0; c < 3; ++c)
+							{
+								pos[c][l] -= a[c][l] * depth;
+								vel[c][l] -= a[c][l] * bounce;
+							}
+							laneEvents[l] |= 1u << PARTICLE_EVENT_COLLIDE;
+						}
+					}
+					break;
+				}
+				}
+			}
+
+			// the life time belongs to the emitter, so writes to it are dropped
+			for (uint32_t l = 0; l < lanes; ++l)
+			{
+				if (!live[l])
+				{
+					laneEvents[l] = 0;
+					continue;
+				}
+
+				Particle& p = batch[l];
+				p.position = XMFLOAT3(r[MODULE_REG_POSITION][0][l], r[MODULE_REG_POSITION][1][l], r[MODULE_REG_POSITION][2][l]);
+				p.age = r[MODULE_REG_POSITION][3][l];
+				p.velocity = XMFLOAT3(r[MODULE_REG_VELOCITY][0][l], r[MODULE_REG_VELOCITY][1][l], r[MODULE_REG_VELOCITY][2][l]);
+			}
+
+			if (events)
+				memcpy(events + base, laneEvents, lanes * sizeof(uint32_t));
+		}
+	}
+}
+
+void ParticleModuleGraph::Run(const ParticleProgram & program, ParticleModuleStage stage, Particle * particles, uint32_t count,
+	const EmitterParams * emitterParams, float deltaTime, float totalTime, uint32_t * events, uint32_t batchVariant)
+{
+	uint32_t start = stage == PARTICLE_STAGE_SPAWN ? 0 : program.length[PARTICLE_STAGE_SPAWN];
+	uint32_t end = start + program.length[stage];
+
+	// MODULE_BATCH_SIZES
+	switch (batchVariant)
+	{
+	case 1:		RunBatched<16>(program, start, end, particles, count, emitterParams, deltaTime, totalTime, events); break;
+	default:	RunBatched<8>(program, start, end, particles, count, emitterParams, deltaTime, totalTime, events); break;
+	}
+}
+
+std::string ParticleModuleGraph::GenerateHLSL() const
+{
+	ParticleProgram program;
+	Compile(program);
+
+	static const char* functionNames[PARTICLE_STAGE_COUNT] = { "SpawnModules", "UpdateModules" };
+	static const char* components = "xyzw";
+
+	std::ostringstream out;
+	out.setf(std::ios::showpoint);
+
+	uint32_t pc = 0;
+	for (uint32_t stage = 0; stage < PARTICLE_STAGE_COUNT; ++stage)
+	{
+		out << "void " << functionNames[stage] << "(inout Particle p, float deltaTime, float totalTime)\n{\n";
+		out << "\tfloat lifeTime = emitterParams[p.emitter].lifeTime;\n";
+		out << "\tfloat4 r0 = float4(p.position, p.age);\n";
+		out << "\tfloat4 r1 = float4(p.velocity, lifeTime);\n";
+		out << "\tfloat4 r2 = float4(deltaTime, lifeTime > 0 ? saturate(p.age / lifeTime) : 0, totalTime, 0);\n";
+		for (uint32_t r = MODULE_REG_TEMP; r < MODULE_REGISTERS; ++r)
+			out << "\tfloat4 r" << r << " = 0;\n";
+
+		for (uint32_t end = pc + program.length[stage]; pc < end; ++pc)
+		{
+			const XMUINT4& ins = program.code[pc];
+			uint32_t d = ins.y, a = ins.z, b = ins.w;
+
+			out << "\t";
+			switch (ins.x)
+			{
+			case MODULE_OP_CONST:
+			{
+				const XMFLOAT4& c = program.constants[a];
+				out << "r" << d << " = float4(" << c.x << ", " << c.y << ", " << c.z << ", " << c.w << ");";
+				break;
+			}
+			case MODULE_OP_MOV:		out << "r" << d << " = r" << a << ";"; break;
+			case MODULE_OP_SPLAT:	out << "r" << d << " = r" << a << "." << components[b & 3] << ";"; break;
+			case MODULE_OP_ADD:		out << "r" << d << " = r" << a << " + r" << b << ";"; break;
+			case MODULE_OP_SUB:		out << "r" << d << " = r" << a << " - r" << b << ";"; break;
+			case MODULE_OP_MUL:		out << "r" << d << " = r" << a << " * r" << b << ";"; break;
+			case MODULE_OP_MAD:		out << "r" << d << " += r" << a << " * r" << b << ";"; break;
+			case MODULE_OP_MIN:		out << "r" << d << " = min(r" << a << ", r" << b << ");"; break;
+			case MODULE_OP_MAX:		out << "r" << d << " = max(r" << a << ", r" << b << ");"; break;
+			case MODULE_OP_SAT:		out << "r" << d << " = saturate(r" << a << ");"; break;
+			case MODULE_OP_MIX:		out << "r" << d << " = lerp(r" << d << ", r" << a << ", r" << b << ".x);"; break;
+			case MODULE_OP_NRM3:	out << "r" << d << " = float4(r" << a << ".xyz * rsqrt(max(dot(r" << a << ".xyz, r" << a << ".xyz), 1e-20)), r" << a << ".w);"; break;
+			case MODULE_OP_COLLIDE:
+				out << "{ float depth = dot(r0.xyz, r" << a << ".xyz) - r" << a << ".w; "
+					<< "float approach = dot(r1.xyz, r" << a << ".xyz); "
+					<< "if (depth < 0 && approach < 0) { "
+					<< "r0.xyz -= r" << a << ".xyz * depth; "
+					<< "r1.xyz -= r" << a << ".xyz * approach * (1 + r" << b << ".x); } }";
+				break;
+			}
+			out << "\n";
+		}
+
+		out << "\tp.position = r0.xyz;\n";
+		out << "\tp.age = r0.w;\n";
+		out << "\tp.velocity = r1.xyz;\n";
+		out << "}\n\n";
+	}
+
+	return out.str();
+}
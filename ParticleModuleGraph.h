@@ -0,0 +1,79 @@
+#pragma once
+
+#include <DirectXMath.h>
+
+#include "EmitterParams.h"
+#include "Particle.h"
+
+#include <string>
+#include <vector>
+
+// Particles the CPU interpreter runs each instruction over at once, picked
+// per call; KernelTuner times them as TUNED_KERNEL_HOST_MODULES
+#define MODULE_BATCH_VARIANT_COUNT	2
+static const uint32_t MODULE_BATCH_SIZES[MODULE_BATCH_VARIANT_COUNT] = { 8, 16 };
+
+// When a module runs: once on the spawned particle, or every frame on
+// live ones (before the velocity is integrated)
+enum ParticleModuleStage
+{
+	PARTICLE_STAGE_SPAWN,
+	PARTICLE_STAGE_UPDATE,
+	PARTICLE_STAGE_COUNT
+};
+
+enum ParticleModuleType
+{
+	PARTICLE_MODULE_ADD_VELOCITY,	// params.xyz is added to the velocity
+	PARTICLE_MODULE_ADD_FORCE,		// params.xyz is an acceleration
+	PARTICLE_MODULE_DRAG,			// params.x: fraction of the speed lost per second
+	PARTICLE_MODULE_SPEED_BY_AGE,	// speed goes from params.x at birth to params.y at death
+	PARTICLE_MODULE_COLLIDE_PLANE,	// params: plane (xyz normal, w offset), extra.x: restitution
+};
+
+struct ParticleModule
+{
+	ParticleModuleStage				stage;
+	ParticleModuleType				type;
+	DirectX::XMFLOAT4				params;
+	DirectX::XMFLOAT4				extra;
+};
+
+// Bytecode for the module VM in ParticleModules.hlsli, spawn program first
+struct ParticleProgram
+{
+	std::vector<DirectX::XMUINT4>	code;
+	std::vector<DirectX::XMFLOAT4>	constants;
+	uint32_t						length[PARTICLE_STAGE_COUNT];
+};
+
+// Emitter behavior described as data: an ordered stack of modules per
+// stage, applied to every emitter of the pool it's set on. Compiles to the
+// register bytecode the particle kernels interpret, or to straight-line
+// HLSL for effects that are worth a kernel of their own
+class ParticleModuleGraph
+{
+public:
+	void Add(ParticleModuleStage stage, ParticleModuleType type, const DirectX::XMFLOAT4& params, const DirectX::XMFLOAT4& extra = DirectX::XMFLOAT4());
+
+	void Clear() { modules.clear(); }
+
+	// False if the graph doesn't fit MODULE_MAX_CODE / MODULE_MAX_CONSTANTS,
+	// or an instruction uses a register or constant that doesn't exist
+	bool Compile(ParticleProgram& program) const;
+
+	// SpawnModules()/UpdateModules() functions doing what the bytecode does,
+	// with the constants folded in
+	std::string GenerateHLSL() const;
+
+	// Runs one stage of a compiled program on the CPU, the
+	// MODULE_BATCH_SIZES[batchVariant] particles per instruction, the way the
+	// GPU kernels do it one per thread. Dead particles are left alone.
+	// events, if given, gets the mask of (1 << PARTICLE_EVENT_*) bits of
+	// every particle
+	static void Run(const ParticleProgram& program, ParticleModuleStage stage, Particle* particles, uint32_t count,
+		const EmitterParams* emitterParams, float deltaTime, float totalTime, uint32_t* events = nullptr, uint32_t batchVariant = 0);
+
+private:
+	std::vector<ParticleModule>		modules;
+};
\ No newline at end of file
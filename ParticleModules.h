@@ -0,0 +1,35 @@
+#ifndef _PARTICLE_MODULES_
+#define _PARTICLE_MODULES_
+
+#include "ShaderCommon.h"
+
+// Register file of the module VM. Every register is a float4; the first
+// three are loaded from the particle before a program runs and the first
+// two are written back after it.
+#define MODULE_REGISTERS		8
+#define MODULE_REG_POSITION		0	// w = age
+#define MODULE_REG_VELOCITY		1	// w = life time of the emitter, read only
+#define MODULE_REG_TIME			2	// (deltaTime, age / life time, totalTime, 0), read only
+#define MODULE_REG_TEMP			3	// first scratch register
+
+// Per-pool program size limits, spawn and update programs together
+#define MODULE_MAX_CODE			256
+#define MODULE_MAX_CONSTANTS	64
+
+// Instructions are uint4 (op, dst, a, b); a and b are registers unless noted
+#define MODULE_OP_CONST			0	// dst = constants[a]
+#define MODULE_OP_MOV			1	// dst = a
+#define MODULE_OP_SPLAT			2	// dst = a[b], b is a component index
+#define MODULE_OP_ADD			3	// dst = a + b
+#define MODULE_OP_SUB			4	// dst = a - b
+#define MODULE_OP_MUL			5	// dst = a * b
+#define MODULE_OP_MAD			6	// dst += a * b
+#define MODULE_OP_MIN			7	// dst = min(a, b)
+#define MODULE_OP_MAX			8	// dst = max(a, b)
+#define MODULE_OP_SAT			9	// dst = saturate(a)
+#define MODULE_OP_MIX			10	// dst = lerp(dst, a, b.x)
+#define MODULE_OP_NRM3			11	// dst = (normalize(a.xyz), a.w), zero stays zero
+#define MODULE_OP_COLLIDE		12	// bounce off plane a (xyz normal, w offset) with restitution b.x
+#define MODULE_OP_COUNT			13
+
+#endif
\ No newline at end of file
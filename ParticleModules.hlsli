@@ -0,0 +1,74 @@
+#ifndef _PARTICLE_MODULES_HLSLI_
+#define _PARTICLE_MODULES_HLSLI_
+
+#include "ParticleParams.hlsli"
+#include "ParticleModules.h"
+#include "ParticleEvents.h"
+
+// compiled module programs of the pool, see ParticleModuleGraph
+StructuredBuffer<uint4> moduleCode : register(t1);
+StructuredBuffer<float4> moduleConstants : register(t2);
+
+// Runs `length` instructions starting at `start` on one particle. Returns
+// the events it caused as a mask of (1 << PARTICLE_EVENT_*) bits. Register
+// and constant indices are checked by ParticleModuleGraph::Compile
+uint RunModules(inout Particle p, uint start, uint length, float deltaTime, float totalTime)
+{
+	uint events = 0;
+	if (length == 0)
+		return events;
+
+	float4 r[MODULE_REGISTERS];
+	[unroll]
+	for (uint i = MODULE_REG_TEMP; i < MODULE_REGISTERS; ++i)
+		r[i] = float4(0, 0, 0, 0);
+
+	float lifeTime = emitterParams[p.emitter].lifeTime;
+	r[MODULE_REG_POSITION] = float4(p.position, p.age);
+	r[MODULE_REG_VELOCITY] = float4(p.velocity, lifeTime);
+	r[MODULE_REG_TIME] = float4(deltaTime, lifeTime > 0 ? saturate(p.age / lifeTime) : 0, totalTime, 0);
+
+	[loop]
+	for (uint pc = start; pc < start + length; ++pc)
+	{
+		uint4 ins = moduleCode[pc];
+
+		[branch]
+		switch (ins.x)
+		{
+		case MODULE_OP_CONST:	r[ins.y] = moduleConstants[ins.z]; break;
+		case MODULE_OP_MOV:		r[ins.y] = r[ins.z]; break;
+		case MODULE_OP_SPLAT:	r[ins.y] = r[ins.z][ins.w]; break;
+		case MODULE_OP_ADD:		r[ins.y] = r[ins.z] + r[ins.w]; break;
+		case MODULE_OP_SUB:		r[ins.y] = r[ins.z] - r[ins.w]; break;
+		case MODULE_OP_MUL:		r[ins.y] = r[ins.z] * r[ins.w]; break;
+		case MODULE_OP_MAD:		r[ins.y] += r[ins.z] * r[ins.w]; break;
+		case MODULE_OP_MIN:		r[ins.y] = min(r[ins.z], r[ins.w]); break;
+		case MODULE_OP_MAX:		r[ins.y] = max(r[ins.z], r[ins.w]); break;
+		case MODULE_OP_SAT:		r[ins.y] = saturate(r[ins.z]); break;
+		case MODULE_OP_MIX:		r[ins.y] = lerp(r[ins.y], r[ins.z], r[ins.w].x); break;
+		case MODULE_OP_NRM3:	r[ins.y] = float4(r[ins.z].xyz * rsqrt(max(dot(r[ins.z].xyz, r[ins.z].xyz), 1e-20)), r[ins.z].w); break;
+		case MODULE_OP_COLLIDE:
+		{
+			float4 plane = r[ins.z];
+			float depth = dot(r[MODULE_REG_POSITION].xyz, plane.xyz) - plane.w;
+			float approach = dot(r[MODULE_REG_VELOCITY].xyz, plane.xyz);
+			if (depth < 0 && approach < 0)
+			{
+				r[MODULE_REG_POSITION].xyz -= plane.xyz * depth;
+				r[MODULE_REG_VELOCITY].xyz -= plane.xyz * approach * (1 + r[ins.w].x);
+				events |= 1u << PARTICLE_EVENT_COLLIDE;
+			}
+			break;
+		}
+		}
+	}
+
+	// the life time belongs to the emitter, so writes to it are dropped
+	p.position = r[MODULE_REG_POSITION].xyz;
+	p.age = r[MODULE_REG_POSITION].w;
+	p.velocity = r[MODULE_REG_VELOCITY].xyz;
+	return events;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef _PARTICLE_PARAMS_
+#define _PARTICLE_PARAMS_
+
+#include "Particle.h"
+#include "EmitterParams.h"
+#include "ParticleRecycle.h"
+#include "ParticleSize.hlsli"
+
+// per-emitter settings of the pool, indexed by Particle::emitter
+StructuredBuffer<EmitterParams> emitterParams : register(t3);
+
+bool IsAlive(Particle p)
+{
+	return p.emitter != PARTICLE_DEAD;
+}
+
+// one step of the emitter's forces, then the position
+void IntegrateParticle(inout Particle p, float deltaTime)
+{
+	EmitterParams params = emitterParams[p.emitter];
+	p.velocity += params.gravity * deltaTime;
+	p.velocity *= saturate(1 - params.drag * deltaTime);
+	p.position += p.velocity * deltaTime;
+}
+
+// Whether the particle is too small on screen to be worth drawing, as seen
+// from the camera whose view depth is dot(position, depthPlane). Local-space
+// particles are left to the vertex shader, which knows their transform
+bool IsCulled(Particle p, float4 depthPlane, float pixelScale, float minPixels)
+{
+	EmitterParams params = emitterParams[p.emitter];
+	if (params.flags & EMITTER_FLAG_LOCAL_SPACE)
+		return false;
+
+	float depth = dot(float4(p.position, 1), depthPlane);
+	return IsSubPixel(ParticleSize(p.age, params), depth, pixelScale, minPixels);
+}
+
+// how much of its life the particle has used up, in RECYCLE_BUCKETS steps
+uint RecycleBucket(Particle p)
+{
+	float used = saturate(p.age / emitterParams[p.emitter].lifeTime);
+	return min((uint)(used * RECYCLE_BUCKETS), RECYCLE_BUCKETS - 1);
+}
+
+#endif
\ No newline at end of file
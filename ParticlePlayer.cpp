@@ -0,0 +1,282 @@
+#include "ParticlePlayer.h"
+
+#include <windows.h>
+
+#include <algorithm>
+#include <cassert>
+
+ParticlePlayer::ParticlePlayer()
+	:
+	file(INVALID_HANDLE_VALUE),
+	mapping(nullptr),
+	view(nullptr),
+	header(),
+	prefetchFrames(0),
+	node(0),
+	closing(false),
+	nextRecord(0),
+	seekRecord(NO_RECORD),
+	decodedRecord(NO_RECORD)
+{
+}
+
+ParticlePlayer::~ParticlePlayer()
+{
+	Close();
+}
+
+bool ParticlePlayer::Open(const std::wstring & fileName, uint32_t prefetchFrames, uint32_t hostNode)
+{
+	assert(INVALID_HANDLE_VALUE == file);
+	assert(prefetchFrames > 0);
+
+	file = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (INVALID_HANDLE_VALUE == file)
+		return false;
+
+	LARGE_INTEGER fileSize = {};
+	GetFileSizeEx(file, &fileSize);
+
+	mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (nullptr != mapping)
+		view = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (nullptr == view)
+	{
+		Close();
+		return false;
+	}
+
+	// index the frames; the data stays in the mapping until it is decoded
+	const uint8_t* cursor = view;
+	const uint8_t* end = view + fileSize.QuadPart;
+
+	bool ok = (size_t)(end - cursor) >= sizeof(header);
+	if (ok)
+	{
+		memcpy(&header, cursor, sizeof(header));
+		cursor += sizeof(header);
+		ok = header.magic == PARTICLE_RECORDING_MAGIC && header.version == PARTICLE_RECORDING_VERSION;
+	}
+
+	while (ok && (size_t)(end - cursor) >= sizeof(ParticleRecordingFrame))
+	{
+		ParticleRecordingFrame frame;
+		memcpy(&frame, cursor, sizeof(frame));
+		cursor += sizeof(frame);
+
+		// a recording cut short by a crash ends in a partial frame
+		if ((size_t)(end - cursor) < frame.byteCount)
+			break;
+
+		Record record = { frame.frame, 0 != frame.keyframe, cursor, frame.byteCount };
+		records.push_back(record);
+		cursor += frame.byteCount;
+	}
+
+	if (!ok || records.empty() || !records.front().keyframe)
+	{
+		Close();
+		return false;
+	}
+
+	this->prefetchFrames = prefetchFrames;
+	node = hostNode == HOST_NODE_ANY ? HostCurrentNode() : hostNode;
+	for (uint32_t i = 0; i < prefetchFrames + 1; ++i)
+	{
+		Decoded* decoded = new Decoded();
+		decoded->particles = ParticleArray(header.particleCount, Particle(), HostAllocator<Particle>(node));
+		frames.push_back(decoded);
+		freeFrames.push_back(decoded);
+	}
+
+	previous = FieldArray(header.particleCount * PARTICLE_RECORDING_FIELDS, 0, HostAllocator<int32_t>(node));
+	decodedRecord = NO_RECORD;
+	nextRecord = 0;
+	seekRecord = NO_RECORD;
+
+	closing = false;
+	decoder = std::thread(&ParticlePlayer::DecoderLoop, this);
+	return true;
+}
+
+void ParticlePlayer::Close()
+{
+	if (decoder.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			closing = true;
+		}
+		wake.notify_one();
+		decoder.join();
+	}
+
+	if (nullptr != view)
+		UnmapViewOfFile(view);
+	if (nullptr != mapping)
+		CloseHandle(mapping);
+	if (INVALID_HANDLE_VALUE != file)
+		CloseHandle(file);
+	view = nullptr;
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+
+	for (auto iFrame = frames.begin(); iFrame != frames.end(); ++iFrame)
+		delete *iFrame;
+	frames.clear();
+	freeFrames.clear();
+	ready.clear();
+	records.clear();
+}
+
+const Particle * ParticlePlayer::Fetch(uint32_t frame)
+{
+	// last record at or before the frame, the first one if there is none
+	auto iRecord = std::upper_bound(records.begin(), records.end(), frame,
+		[](uint32_t f, const Record& r) { return f < r.frame; });
+	uint32_t record = iRecord == records.begin() ? 0 : (uint32_t)(iRecord - records.begin()) - 1;
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	while (!ready.empty() && ready.front()->record < record)
+	{
+		freeFrames.push_back(ready.front());
+		ready.erase(ready.begin());
+	}
+	wake.notify_one();
+
+	if (!ready.empty() && ready.front()->record == record)
+		return ready.front()->particles.data();
+
+	// close enough ahead of the decoder to just wait for it, otherwise
+	// start over from the record asked for
+	uint32_t upcoming = seekRecord != NO_RECORD ? seekRecord : nextRecord;
+	if (ready.empty() && upcoming <= record && record < upcoming + prefetchFrames)
+		return nullptr;
+
+	freeFrames.insert(freeFrames.end(), ready.begin(), ready.end());
+	ready.clear();
+	seekRecord = record;
+	return nullptr;
+}
+
+void ParticlePlayer::DecoderLoop()
+{
+	// next to the frames it decodes into
+	HostPinThread(node);
+
+	for (;;)
+	{
+		uint32_t record;
+		Decoded* decoded;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [this] {
+				return closing || seekRecord != NO_RECORD || (!freeFrames.empty() && nextRecord < records.size());
+			});
+			if (closing)
+				return;
+
+			if (seekRecord != NO_RECORD)
+			{
+				nextRecord = seekRecord;
+				seekRecord = NO_RECORD;
+			}
+			if (freeFrames.empty() || nextRecord >= records.size())
+				continue;
+
+			record = nextRecord;
+			decoded = freeFrames.back();
+			freeFrames.pop_back();
+		}
+
+		// unless this follows the last record decoded, replay the deltas
+		// from the keyframe before it
+		if (decodedRecord == NO_RECORD || decodedRecord + 1 != record)
+		{
+			uint32_t start = record;
+			while (!records[start].keyframe)
+				--start;
+			for (uint32_t i = start; i < record; ++i)
+				Decode(i, nullptr);
+		}
+
+		Decode(record, decoded->particles.data());
+		decoded->record = record;
+
+		std::lock_guard<std::mutex> guard(lock);
+
+		// a seek that came in meanwhile makes this one useless
+		if (seekRecord == NO_RECORD && nextRecord == record)
+		{
+			ready.push_back(decoded);
+			nextRecord = record + 1;
+		}
+		else
+		{
+			freeFrames.push_back(decoded);
+		}
+	}
+}
+
+static uint32_t GetVarint(const uint8_t*& cursor, const uint8_t* end)
+{
+	uint32_t value = 0;
+	for (uint32_t shift = 0; cursor < end && shift < 32; shift += 7)
+	{
+		uint8_t byte = *cursor++;
+		value |= (uint32_t)(byte & 0x7f) << shift;
+		if (0 == (byte & 0x80))
+			break;
+	}
+	return value;
+}
+
+// mirrors ParticleRecorder::Encode
+void ParticlePlayer::Decode(uint32_t record, Particle * out)
+{
+	const Record& r = records[record];
+	const uint8_t* cursor = r.data;
+	const uint8_t* end = r.data + r.byteCount;
+	const uint32_t count = header.particleCount;
+
+	if (r.keyframe)
+		std::fill(previous.begin(), previous.end(), 0);
+
+	for (uint32_t field = 0; field < PARTICLE_RECORDING_FIELDS; ++field)
+	{
+		int32_t* last = &previous[field * count];
+
+		uint32_t i = 0;
+		while (i < count && cursor < end)
+		{
+			uint32_t zigzag = GetVarint(cursor, end);
+			if (0 == zigzag)
+			{
+				i += min(GetVarint(cursor, end) + 1, count - i);
+				continue;
+			}
+
+			int32_t delta = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+			last[i] = (int32_t)((uint32_t)last[i] + (uint32_t)delta);
+			++i;
+		}
+	}
+
+	decodedRecord = record;
+	if (nullptr == out)
+		return;
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		Particle& p = out[i];
+		p.position.x = previous[0 * count + i] * header.positionStep;
+		p.position.y = previous[1 * count + i] * header.positionStep;
+		p.position.z = previous[2 * count + i] * header.positionStep;
+		p.age = previous[3 * count + i] * header.ageStep;
+		p.velocity.x = previous[4 * count + i] * header.velocityStep;
+		p.velocity.y = previous[5 * count + i] * header.velocityStep;
+		p.velocity.z = previous[6 * count + i] * header.velocityStep;
+		p.emitter = (uint32_t)previous[7 * count + i];
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "HostMemory.h"
+#include "Particle.h"
+#include "ParticleRecorder.h"
+
+// Upload buffers a playback pool cycles through, so that writing a frame
+// never waits on the copy of the one before
+#define PARTICLE_PLAYBACK_UPLOAD_BUFFERS	3
+
+struct ParticlePlaybackDesc
+{
+	float							frameRate;		// recorded frames per second of playback
+	bool							loop;			// else holds the last frame
+	uint32_t						prefetchFrames;	// decoded ahead of the playhead
+	uint32_t						hostNode;		// NUMA node of the decoder thread and its frames
+
+	ParticlePlaybackDesc()
+		:
+		frameRate(60.0f),
+		loop(true),
+		prefetchFrames(4),
+		hostNode(HOST_NODE_ANY)
+	{}
+};
+
+// Reads back a file written by ParticleRecorder. The file is memory-mapped
+// and a worker thread decodes the frames following the last one asked for
+// into a small ring, so the caller only ever copies finished frames out
+class ParticlePlayer
+{
+public:
+	ParticlePlayer();
+	~ParticlePlayer();
+
+	// prefetchFrames: decoded frames kept ready ahead of the playhead.
+	// The decoder thread is pinned to hostNode, where its frames live
+	bool Open(const std::wstring& fileName, uint32_t prefetchFrames, uint32_t hostNode = HOST_NODE_ANY);
+	void Close();
+
+	uint32_t GetParticleCount() const { return header.particleCount; }
+
+	// Frame number just past the last recorded one
+	uint32_t GetFrameCount() const { return records.empty() ? 0 : records.back().frame + 1; }
+
+	// The last recorded frame at or before `frame`, or null while it is
+	// still being decoded. Never blocks. Anything but a short step forward
+	// makes the worker restart from the keyframe before it. The pointer is
+	// valid until the next call
+	const Particle* Fetch(uint32_t frame);
+
+private:
+	static const uint32_t NO_RECORD = 0xFFFFFFFF;
+
+	struct Record
+	{
+		uint32_t					frame;
+		bool						keyframe;
+		const uint8_t*				data;
+		uint32_t					byteCount;
+	};
+
+	typedef std::vector<Particle, HostAllocator<Particle>>	ParticleArray;
+	typedef std::vector<int32_t, HostAllocator<int32_t>>	FieldArray;
+
+	struct Decoded
+	{
+		ParticleArray				particles;
+		uint32_t					record;		// index into records
+	};
+
+	void DecoderLoop();
+	void Decode(uint32_t record, Particle* out);
+
+	void*							file;		// HANDLE
+	void*							mapping;	// HANDLE
+	const uint8_t*					view;
+
+	ParticleRecordingHeader			header;
+	std::vector<Record>				records;
+	uint32_t						prefetchFrames;
+	uint32_t						node;		// hostNode resolved
+
+	std::thread						decoder;
+	std::mutex						lock;
+	std::condition_variable			wake;
+	bool							closing;
+
+	std::vector<Decoded*>			frames;		// all of them, owned
+	std::vector<Decoded*>			freeFrames;
+	std::vector<Decoded*>			ready;		// decoded, in record order
+	uint32_t						nextRecord;	// next one the decoder will hand out
+	uint32_t						seekRecord;	// record to restart from, or NO_RECORD
+
+	// decoder thread only
+	FieldArray						previous;		// quantized fields as of decodedRecord
+	uint32_t						decodedRecord;
+};
@@ -0,0 +1,111 @@
+#include "ParticleSystem.h"
+#include "ParticlePointCloud.h"
+#include "Particle.h"
+
+#include <windows.h>
+
+#include <cassert>
+
+bool ParticleSystem::LoadPointCloud(const std::wstring & texFileName, const std::wstring & pointFile)
+{
+	if (poolMap.find(texFileName) != poolMap.end())
+		return false;
+
+	HANDLE file = CreateFileW(pointFile.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (INVALID_HANDLE_VALUE == file)
+		return false;
+
+	LARGE_INTEGER fileSize = {};
+	GetFileSizeEx(file, &fileSize);
+
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const uint8_t* view = nullptr != mapping ? static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+
+	const PointCloudHeader* header = reinterpret_cast<const PointCloudHeader*>(view);
+	bool ok = nullptr != view
+		&& (uint64_t)fileSize.QuadPart >= sizeof(PointCloudHeader)
+		&& header->magic == POINT_CLOUD_MAGIC
+		&& header->version == POINT_CLOUD_VERSION
+		&& header->pointCount > 0
+		&& header->pointCount <= 0xFFFFFFFF
+		&& (uint64_t)fileSize.QuadPart >= sizeof(PointCloudHeader) + header->pointCount * (header->hasEmitterIds ? 16 : 12);
+
+	// the ids index the pool's emitter params on the GPU, which hold
+	// MAX_EMITTERS entries
+	if (ok && header->hasEmitterIds)
+	{
+		const uint32_t* ids = reinterpret_cast<const uint32_t*>(view + sizeof(PointCloudHeader) + 12 * (size_t)header->pointCount);
+		for (uint64_t i = 0; ok && i < header->pointCount; ++i)
+			ok = ids[i] < MAX_EMITTERS;
+	}
+
+	if (ok)
+	{
+		uint32_t pointCount = (uint32_t)header->pointCount;
+		const float* positions = reinterpret_cast<const float*>(view + sizeof(PointCloudHeader));
+		const uint32_t* emitterIds = header->hasEmitterIds ? reinterpret_cast<const uint32_t*>(positions + 3 * (size_t)pointCount) : nullptr;
+
+		// stateless: no dead list, no simulate pass, every slot drawn
+		ParticlePoolDesc desc;
+		desc.maxParticles = pointCount;
+		desc.stateless = true;
+		CreateParticlePool(texFileName, desc);
+
+		// points are converted from the mapped file straight into upload
+		// buffers, two of them so one is filled while the other is copied
+		ID3D11Buffer* upload[2] = {};
+		CD3D11_BUFFER_DESC uploadDesc(POINT_CLOUD_UPLOAD_POINTS * sizeof(Particle), 0, D3D11_USAGE_STAGING, D3D11_CPU_ACCESS_WRITE);
+		for (uint32_t i = 0; i < 2; ++i)
+		{
+			HRESULT hr = device->CreateBuffer(&uploadDesc, nullptr, &upload[i]);
+			assert(hr == S_OK);
+		}
+
+		uint32_t first = poolMap[texFileName];
+		uint32_t next = 0;
+		for (uint32_t c = 0; c < pools[first].chunkCount; ++c)
+		{
+			ParticlePool& pool = pools[first + c];
+			pool.external = true;
+
+			for (uint32_t done = 0; done < pool.particleConstants.maxParticles; done += POINT_CLOUD_UPLOAD_POINTS)
+			{
+				uint32_t count = min(POINT_CLOUD_UPLOAD_POINTS, pool.particleConstants.maxParticles - done);
+
+				D3D11_MAPPED_SUBRESOURCE mapped = {};
+				HRESULT hr = context->Map(upload[next], 0, D3D11_MAP_WRITE, 0, &mapped);
+				assert(hr == S_OK);
+
+				Particle* particles = reinterpret_cast<Particle*>(mapped.pData);
+				for (uint32_t i = 0; i < count; ++i)
+				{
+					size_t point = (size_t)pool.chunkBase + done + i;
+
+					Particle& p = particles[i];
+					p.position = DirectX::XMFLOAT3(positions[3 * point], positions[3 * point + 1], positions[3 * point + 2]);
+					p.age = 0.0f;
+					p.velocity = DirectX::XMFLOAT3();
+					p.emitter = nullptr != emitterIds ? emitterIds[point] : 0;
+				}
+
+				context->Unmap(upload[next], 0);
+
+				D3D11_BOX box = { 0, 0, 0, count * (UINT)sizeof(Particle), 1, 1 };
+				context->CopySubresourceRegion(pool.bufParticles, 0, done * (UINT)sizeof(Particle), 0, 0, upload[next], 0, &box);
+
+				next ^= 1;
+			}
+		}
+
+		upload[0]->Release();
+		upload[1]->Release();
+	}
+
+	if (nullptr != view)
+		UnmapViewOfFile(view);
+	if (nullptr != mapping)
+		CloseHandle(mapping);
+	CloseHandle(file);
+
+	return ok;
+}
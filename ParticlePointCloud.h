@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+// Binary point file read by ParticleSystem::LoadPointCloud: a header, then
+// pointCount float x, y, z positions, then, if hasEmitterIds, pointCount
+// uint32_t emitter ids, each below MAX_EMITTERS. Without ids every point
+// uses emitter 0
+#define POINT_CLOUD_MAGIC		0x53545050	// "PPTS"
+#define POINT_CLOUD_VERSION		1
+
+// Points converted per upload; the file is never held in memory as a whole
+#define POINT_CLOUD_UPLOAD_POINTS	(64 * 1024)
+
+struct PointCloudHeader
+{
+	uint32_t	magic;
+	uint32_t	version;
+	uint64_t	pointCount;
+	uint32_t	hasEmitterIds;
+	uint32_t	_padding;
+};
\ No newline at end of file
@@ -4,12 +4,51 @@ void ParticlePool::CleanUp()
 {
 	bufParticleConstants->Release();
 	bufParticles->Release();
-	bufDeadList->Release();
+	if (bufDeadList) bufDeadList->Release();
 	bufDrawList->Release();
+	if (bufRecycleList) bufRecycleList->Release();
+	if (bufRecycleListUAV) bufRecycleListUAV->Release();
+	if (bufRecycleListSRV) bufRecycleListSRV->Release();
+	bufStats->Release();
+	bufStatsStaging->Release();
 	bufParticlesUAV->Release();
 	bufParticlesSRV->Release();
-	bufDeadListUAV->Release();
+	if (bufDeadListUAV) bufDeadListUAV->Release();
 	bufDrawListUAV->Release();
 	bufDrawListSRV->Release();
+	bufStatsUAV->Release();
+	if (bufOccupancy) bufOccupancy->Release();
+	if (bufOccupancyUAV) bufOccupancyUAV->Release();
+	if (bufBlockFull) bufBlockFull->Release();
+	if (bufBlockFullUAV) bufBlockFullUAV->Release();
+	if (bufSortKeys) bufSortKeys->Release();
+	if (bufSortKeysUAV) bufSortKeysUAV->Release();
+	if (bufSortKeysSRV) bufSortKeysSRV->Release();
+	if (bufReorderScratch) bufReorderScratch->Release();
+	if (bufReorderScratchUAV) bufReorderScratchUAV->Release();
+	if (bufModuleCode) bufModuleCode->Release();
+	if (bufModuleCodeSRV) bufModuleCodeSRV->Release();
+	if (bufModuleConstants) bufModuleConstants->Release();
+	if (bufModuleConstantsSRV) bufModuleConstantsSRV->Release();
+	bufEmitterParams->Release();
+	bufEmitterParamsSRV->Release();
+	if (bufEmitterRanks) bufEmitterRanks->Release();
+	if (bufEmitterRanksSRV) bufEmitterRanksSRV->Release();
+	bufEmitterTransforms->Release();
+	bufEmitterTransformsSRV->Release();
+	if (bufInstances) bufInstances->Release();
+	if (bufInstancesSRV) bufInstancesSRV->Release();
+	if (bufExpanded) bufExpanded->Release();
+	if (bufExpandedUAV) bufExpandedUAV->Release();
+	if (bufExpandedSRV) bufExpandedSRV->Release();
+	if (bufEvents) bufEvents->Release();
+	if (bufEventsUAV) bufEventsUAV->Release();
+	if (bufEventCount) bufEventCount->Release();
+	if (bufEventCountUAV) bufEventCountUAV->Release();
+	for (uint32_t i = 0; i < PARTICLE_EVENT_READBACK_FRAMES; ++i)
+	{
+		if (bufEventStaging[i]) bufEventStaging[i]->Release();
+		if (bufEventCountStaging[i]) bufEventCountStaging[i]->Release();
+	}
 	texSRV->Release();
 }
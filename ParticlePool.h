@@ -6,29 +6,257 @@
 #include <vector>
 
 #include "Emitter.h"
+#include "EmitterParams.h"
+#include "HostMemory.h"
+#include "ParticleEvents.h"
+#include "ParticleInstance.h"
+
+// How a pool finds free slots for new particles
+enum ParticleAllocator
+{
+	PARTICLE_ALLOCATOR_DEAD_LIST,	// append/consume list of free slot indices
+	PARTICLE_ALLOCATOR_BITSET,		// one occupancy bit per slot, see ParticleBitset.h
+};
+
+// How a pool's particles are turned into quads when drawn
+enum ParticleDrawStrategy
+{
+	PARTICLE_DRAW_INSTANCED,	// an instance of a six-index quad per particle
+	PARTICLE_DRAW_VERTEX_ID,	// one instance of six vertices per particle, found by SV_VertexID / 6
+	PARTICLE_DRAW_EXPANDED,		// ParticleExpandCS writes every vertex out first, see ParticleVertex.h
+	PARTICLE_DRAW_STRATEGY_COUNT,
+	PARTICLE_DRAW_AUTO = PARTICLE_DRAW_STRATEGY_COUNT,
+};
+
+// Creation-time settings of a pool
+struct ParticlePoolDesc
+{
+	uint32_t						maxParticles;
+	// OVERFLOW_*. OVERFLOW_RECYCLE and OVERFLOW_STEAL cost two extra passes
+	// over the pool on every frame something spawns from the dead list
+	uint32_t						overflowPolicy;
+
+	// Give every emitter its own slice of the pool, sized emitRate * lifeTime,
+	// and spawn into it as a ring instead of going through the dead list.
+	// Slices are handed out on the pool's first update; emitters created
+	// later, or that no longer fit, keep using the pool's allocator
+	bool							ringAllocation;
+
+	// The bitset costs a bit per slot instead of the dead list's 4 bytes and
+	// claims a whole 64-slot block's worth of spawns per atomic. Spawns that
+	// don't fit are always dropped, whatever overflowPolicy says
+	ParticleAllocator				allocator;
+
+	// Spawn and integrate in a single sweep over the pool (ParticleFusedCS):
+	// dead slots are found by the sweep itself, so the pool needs neither an
+	// allocator nor a separate emitter pass. New particles get a partial
+	// first step. Ignores ringAllocation, allocator and overflowPolicy
+	bool							fusedUpdate;
+
+	// Every reorderInterval frames (0 = never), sort the pool's slots by the
+	// Morton code of their position so that neighbours in space end up
+	// neighbours in memory, and rebuild the dead list to match. The sort is
+	// spread over frames at reorderStepsPerFrame bitonic steps each (0 = all
+	// at once). Ring slots are left where they are. Not for bitset pools.
+	// ParticlePoolTimings shows what it saves the simulate pass
+	uint32_t						reorderInterval;
+	uint32_t						reorderStepsPerFrame;
+	float							reorderCellSize;	// world size of one Morton grid cell
+
+	// Pools larger than this are split into chunks of at most this many
+	// particles, each with its own buffers and dispatches, and every emitter
+	// is run in each chunk at a share of its rate. 0 = the largest chunk
+	// D3D11 guarantees to support
+	uint32_t						chunkParticles;
+
+	// NUMA node the pool's host-side arrays live on (emitters and their
+	// dispatch order); HOST_NODE_ANY = the node of the creating thread
+	uint32_t						hostNode;
+
+	// Room for this many events per frame and chunk (0 = no events), and
+	// which PARTICLE_EVENT_* types to report as (1 << type) bits. Events are
+	// read back PARTICLE_EVENT_READBACK_FRAMES frames late, see Subscribe
+	uint32_t						eventCapacity;
+	uint32_t						eventMask;
+
+	// Simulate the pool once and draw it once per instance given to
+	// ParticleSystem::SetInstances, up to MAX_PARTICLE_INSTANCES, in a
+	// single draw. Draws nothing until instances are set
+	bool							instanced;
+
+	// No simulate pass at all: particles keep their spawn time, position and
+	// velocity, and the vertex shader evaluates them in closed form under
+	// the emitter's gravity (drag and update modules are ignored) and drops
+	// the expired ones. All emitters spawn into one ring over the whole
+	// pool, so size it for the sum of emitRate * lifeTime. Every slot is
+	// drawn every frame. Ignores every other setting except instanced
+	bool							stateless;
+
+	// Tiny instances are slow on some GPUs, see ParticleDrawStrategy.
+	// PARTICLE_DRAW_AUTO times every strategy on the pool's first draws and
+	// keeps the fastest for pools of its size, see
+	// ParticleSystem::GetFastestDrawStrategy. Instanced pools, and chunks
+	// whose vertices won't fit a buffer, can't be expanded: they draw
+	// PARTICLE_DRAW_VERTEX_ID instead, and PARTICLE_DRAW_AUTO as instanced
+	ParticleDrawStrategy			drawStrategy;
+
+	ParticlePoolDesc()
+		:
+		maxParticles(1024),
+		overflowPolicy(OVERFLOW_DROP),
+		ringAllocation(false),
+		allocator(PARTICLE_ALLOCATOR_DEAD_LIST),
+		fusedUpdate(false),
+		reorderInterval(0),
+		reorderStepsPerFrame(0),
+		reorderCellSize(1.0f),
+		chunkParticles(0),
+		hostNode(HOST_NODE_ANY),
+		eventCapacity(0),
+		eventMask(PARTICLE_EVENT_MASK_ALL),
+		instanced(false),
+		stateless(false),
+		drawStrategy(PARTICLE_DRAW_INSTANCED)
+	{}
+};
+
+// Running totals read back from the pool's stats buffer, a few frames late
+struct ParticlePoolStats
+{
+	uint32_t						dropped;		// spawns lost to an empty dead list
+	uint32_t						recycled;		// live particles overwritten by new spawns
+	uint32_t						stolen;			// and under OVERFLOW_STEAL, taken from lower-priority emitters
+	uint32_t						eventsDropped;	// events past eventCapacity in their frame
+	uint32_t						eventFramesSkipped;	// frames whose events were lost to a full readback ring
+};
+
+// GPU milliseconds of a frame's simulate pass, summed over the pool's
+// chunks and smoothed over recent frames; 0 until measured. Only timed
+// while ParticleSystem::SetProfiling is on, which alternates frames
+// between the pool's specialized kernel and the one with every feature
+// (fused pools and pools that use every feature have no allFeatures)
+struct ParticlePoolTimings
+{
+	float							simulate;
+	float							beforeReorder;	// frames just before a Morton sort starts, see reorderInterval
+	float							afterReorder;	// and just after one finished
+	float							allFeatures;	// the same pass with every feature compiled in, see ParticleFeatures.h
+};
 
 struct ParticlePool
 {
 	struct {
 		float						deltaTime;
 		uint32_t					maxParticles;
-		uint32_t					_padding1;
-		uint32_t					_padding2;
+		uint32_t					ringStart;		// [ringStart, maxParticles) is owned by emitter rings
+		uint32_t					_padding;
 	}								particleConstants;
 
 	ID3D11Buffer*					bufParticleConstants; 
 	ID3D11Buffer*					bufParticles;
 	ID3D11Buffer*					bufDeadList;
 	ID3D11Buffer*					bufDrawList;
+	ID3D11Buffer*					bufRecycleList;	// OVERFLOW_RECYCLE / OVERFLOW_STEAL victims of this frame's spawns
+	ID3D11Buffer*					bufStats;
+	ID3D11Buffer*					bufStatsStaging;
+	ID3D11Buffer*					bufOccupancy;
+	ID3D11Buffer*					bufBlockFull;
 	ID3D11UnorderedAccessView*		bufParticlesUAV;
 	ID3D11ShaderResourceView*		bufParticlesSRV;
 	ID3D11UnorderedAccessView*		bufDeadListUAV;
 	ID3D11UnorderedAccessView*		bufDrawListUAV;
 	ID3D11ShaderResourceView*		bufDrawListSRV;
+	ID3D11UnorderedAccessView*		bufRecycleListUAV;
+	ID3D11ShaderResourceView*		bufRecycleListSRV;
+	ID3D11UnorderedAccessView*		bufStatsUAV;
+	ID3D11UnorderedAccessView*		bufOccupancyUAV;
+	ID3D11UnorderedAccessView*		bufBlockFullUAV;
+	ID3D11Buffer*					bufSortKeys;
+	ID3D11UnorderedAccessView*		bufSortKeysUAV;
+	ID3D11ShaderResourceView*		bufSortKeysSRV;
+	ID3D11Buffer*					bufReorderScratch;
+	ID3D11UnorderedAccessView*		bufReorderScratchUAV;
+	ID3D11Buffer*					bufModuleCode;
+	ID3D11ShaderResourceView*		bufModuleCodeSRV;
+	ID3D11Buffer*					bufModuleConstants;
+	ID3D11ShaderResourceView*		bufModuleConstantsSRV;
+	ID3D11Buffer*					bufEmitterParams;
+	ID3D11ShaderResourceView*		bufEmitterParamsSRV;
+	ID3D11Buffer*					bufEmitterRanks;	// OVERFLOW_STEAL only
+	ID3D11ShaderResourceView*		bufEmitterRanksSRV;
+	ID3D11Buffer*					bufEmitterTransforms;
+	ID3D11ShaderResourceView*		bufEmitterTransformsSRV;
+	ID3D11Buffer*					bufInstances;
+	ID3D11ShaderResourceView*		bufInstancesSRV;
+	ID3D11Buffer*					bufExpanded;	// PARTICLE_DRAW_EXPANDED vertices, six per particle
+	ID3D11UnorderedAccessView*		bufExpandedUAV;
+	ID3D11ShaderResourceView*		bufExpandedSRV;
+	ID3D11Buffer*					bufEvents;
+	ID3D11UnorderedAccessView*		bufEventsUAV;
+	ID3D11Buffer*					bufEventCount;
+	ID3D11UnorderedAccessView*		bufEventCountUAV;
+	ID3D11Buffer*					bufEventStaging[PARTICLE_EVENT_READBACK_FRAMES];
+	ID3D11Buffer*					bufEventCountStaging[PARTICLE_EVENT_READBACK_FRAMES];
 	ID3D11ShaderResourceView*		texSRV;
+	std::vector<DirectX::XMFLOAT4>	atlasRects;		// uv rect of each texture packed into texSRV, empty if it holds one
 	bool							particleFirstUpdate;
 
-	std::vector<Emitter>			emitters;
+	uint32_t						spawnModules;	// module program lengths, the update
+	uint32_t						updateModules;	// program follows the spawn one
+
+	uint32_t						eventCapacity;
+	uint32_t						eventMask;
+	uint32_t						eventHead;		// oldest staging slot still in flight
+	uint32_t						eventsInFlight;
+	std::vector<ParticleEvent>		hostEvents;		// from PostEvents, on the first chunk only
+
+	bool							instanced;
+	uint32_t						instanceCount;
+
+	ParticleDrawStrategy			drawStrategy;
+
+	uint32_t						chunkIndex;		// this chunk's place in its pool
+	uint32_t						chunkBase;		// first particle of this chunk, counted across the pool
+	uint32_t						chunkCount;		// chunks the pool was split into, the first one is in poolMap
+	float							chunkShare;		// fraction of the emit rate this chunk runs
+
+	uint32_t						overflowPolicy;
+	uint32_t						spawnsClamped;	// dropped before the dispatch, more in a frame than the chunk holds
+	bool							ringAllocation;
+	ParticleAllocator				allocator;
+	bool							fusedUpdate;
+	bool							stateless;
+	uint32_t						statelessHead;	// next slot of the pool-wide spawn ring
+	bool							external;		// stateless, particles written by the host and kept as they are
+	uint32_t						features;		// PARTICLE_FEATURE_* mask picking the simulate kernel
+
+	uint32_t						reorderInterval;
+	uint32_t						reorderStepsPerFrame;
+	float							reorderCellSize;
+	uint32_t						reorderFrames;		// frames since the last sort started
+	uint32_t						reorderCount;		// slots being sorted, fixed for the whole sort
+	uint32_t						reorderPaddedCount;
+	uint32_t						reorderBlockSize;	// bitonic step to run next,
+	uint32_t						reorderStride;		// stride 0 = no sort in flight
+	uint32_t						reorderSinceSort;	// frames since the last sort finished, up to PROFILE_REORDER_FRAMES
+
+	ParticlePoolStats				stats;
+	bool							statsPending;
+	ParticlePoolTimings				timings;		// this chunk's alone
+
+	typedef std::vector<Emitter, HostAllocator<Emitter>>	EmitterArray;
+	typedef std::vector<uint32_t, HostAllocator<uint32_t>>	IndexArray;
+	typedef std::vector<EmitterParams, HostAllocator<EmitterParams>>	EmitterParamsArray;
+	typedef std::vector<DirectX::XMFLOAT4X4, HostAllocator<DirectX::XMFLOAT4X4>>	TransformArray;
+
+	EmitterArray					emitters;
+	EmitterParamsArray				emitterParams;	// mirrored in bufEmitterParams
+	bool							emitterParamsDirty;
+	TransformArray					emitterTransforms;	// mirrored in bufEmitterTransforms
+	bool							emitterTransformsDirty;
+	IndexArray						emitOrder;		// emitter indices in dispatch order
+	IndexArray						emitterRanks;	// OVERFLOW_STEAL: rank of each emitter's priority, mirrored in bufEmitterRanks
+	bool							emitOrderDirty;
 
 	void CleanUp();
 };
\ No newline at end of file
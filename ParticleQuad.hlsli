@@ -0,0 +1,132 @@
+#ifndef _PARTICLE_QUAD_
+#define _PARTICLE_QUAD_
+
+#include "Particle.h"
+#include "EmitterParams.h"
+#include "ParticleInstance.h"
+#include "ParticleSize.hlsli"
+
+// What a particle's quad is built from, shared by ParticleVS and
+// ParticleExpandCS
+
+StructuredBuffer<Particle> particles : register(t0);
+
+StructuredBuffer<uint> drawList : register(t1);
+
+StructuredBuffer<EmitterParams> emitterParams : register(t2);
+
+// world matrices of local-space emitters, transposed like the camera's
+StructuredBuffer<float4x4> emitterTransforms : register(t3);
+
+StructuredBuffer<ParticleInstance> instances : register(t4);
+
+
+cbuffer CameraConstants : register(b0)
+{
+	matrix view;
+	matrix projection;
+	float pixelScale;	// pixels per unit of world size over view depth
+	float minPixels;	// quads smaller than this on screen are dropped, 0 = none
+	float maxPixels;	// and larger ones shrunk to it, 0 = no limit
+};
+
+cbuffer PoolConstants : register(b1)
+{
+	uint instanceCount;	// 0 = not an instanced pool
+	uint allSlots;		// no draw list: draw every slot, dropping the dead ones
+	uint stateless;		// positions are evaluated here
+	float totalTime;
+	uint vertexIds;		// six vertices per copy instead of an instance per particle
+};
+
+struct V2F
+{
+	float4 position : SV_POSITION;
+	float2 texcoord : TEXCOORD0;
+	float4 color : COLOR0;
+};
+
+// corners of a quad's two triangles, in the order of bufQuadIndices
+static const uint QUAD_CORNERS[6] = { 0, 2, 3, 0, 3, 1 };
+
+// Corner `corner` (x in bit 0, y in bit 1) of copy `copy` of the particle
+// drawn `index`th
+V2F ParticleCorner(uint index, uint copy, uint corner)
+{
+	V2F output;
+
+	uint pid = allSlots ? index : drawList[index];
+	Particle particle = particles[pid];
+
+	// stateless and playback pools have no simulate pass, so dead and
+	// expired slots are drawn too and dropped here as degenerate quads
+	if (allSlots && particle.emitter == PARTICLE_DEAD)
+	{
+		output = (V2F)0;
+		return output;
+	}
+
+	EmitterParams params = emitterParams[particle.emitter];
+
+	// closed form of ParticleCS without drag
+	if (stateless)
+	{
+		float age = totalTime - particle.age;
+		if (age > params.lifeTime)
+		{
+			output = (V2F)0;
+			return output;
+		}
+
+		particle.age = age;
+		particle.position += particle.velocity * age + 0.5 * params.gravity * age * age;
+	}
+
+	ParticleInstance instance = (ParticleInstance)0;
+	if (instanceCount > 0)
+	{
+		instance = instances[copy];
+
+		// show the particle as it will be timeOffset later, wrapped around
+		// its life so it stays visible. Only gravity is replayed, so copies
+		// of particles with drag or modules drift from the real path
+		float age = fmod(particle.age + instance.timeOffset, params.lifeTime);
+		float t = age - particle.age;
+		particle.position += particle.velocity * t + 0.5 * params.gravity * t * t;
+		particle.age = age;
+	}
+
+	float4 pos = float4(particle.position, 1);
+
+	if (params.flags & EMITTER_FLAG_LOCAL_SPACE)
+		pos = mul(pos, emitterTransforms[particle.emitter]);
+
+	if (instanceCount > 0)
+		pos = mul(pos, instance.transform);
+
+	pos = mul(pos, view);
+
+	// the simulate pass culls most sub-pixel particles already, but not
+	// those of stateless, local-space or instanced pools
+	float size = ParticleSize(particle.age, params);
+	if (IsSubPixel(size, pos.z, pixelScale, minPixels))
+	{
+		output = (V2F)0;
+		return output;
+	}
+
+	// near the camera, stop growing on screen past maxPixels
+	if (maxPixels > 0 && pos.z > 0)
+		size = min(size, maxPixels * pos.z / pixelScale);
+
+	float2 uv = float2(corner % 2, corner / 2);
+	pos.xy += (uv - 0.5) * size;
+
+	output.position = mul(pos, projection);
+	output.texcoord = params.uvRect.xy + uv * params.uvRect.zw;
+	output.color = params.color;
+
+	return output;
+}
+
+#endif
\ No newline at end of file
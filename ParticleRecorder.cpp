@@ -0,0 +1,249 @@
+#include "ParticleRecorder.h"
+
+#include <windows.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+ParticleRecorder::ParticleRecorder()
+	:
+	file(INVALID_HANDLE_VALUE),
+	particleCount(0),
+	node(0),
+	closing(false),
+	acquired(nullptr),
+	stats()
+{
+}
+
+ParticleRecorder::~ParticleRecorder()
+{
+	Close();
+}
+
+bool ParticleRecorder::Open(const std::wstring & fileName, uint32_t particleCount, const ParticleRecorderDesc & desc)
+{
+	assert(INVALID_HANDLE_VALUE == file);
+	assert(desc.queueFrames > 0);
+	assert(desc.keyframeInterval > 0);
+
+	file = CreateFileW(fileName.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (INVALID_HANDLE_VALUE == file)
+		return false;
+
+	this->particleCount = particleCount;
+	this->desc = desc;
+	node = desc.hostNode == HOST_NODE_ANY ? HostCurrentNode() : desc.hostNode;
+
+	ParticleRecordingHeader header = {};
+	header.magic = PARTICLE_RECORDING_MAGIC;
+	header.version = PARTICLE_RECORDING_VERSION;
+	header.particleCount = particleCount;
+	header.positionStep = desc.positionStep;
+	header.velocityStep = desc.velocityStep;
+	header.ageStep = desc.ageStep;
+
+	DWORD written = 0;
+	WriteFile(file, &header, sizeof(header), &written, nullptr);
+	stats = ParticleRecorderStats();
+	stats.bytesWritten = written;
+
+	// all frame memory is allocated up front, the producer never allocates
+	for (uint32_t i = 0; i < desc.queueFrames; ++i)
+	{
+		Frame* frame = new Frame();
+		frame->particles = ParticleArray(particleCount, Particle(), HostAllocator<Particle>(node));
+		frames.push_back(frame);
+		freeFrames.push_back(frame);
+	}
+
+	previous = FieldArray(particleCount * PARTICLE_RECORDING_FIELDS, 0, HostAllocator<int32_t>(node));
+
+	closing = false;
+	writer = std::thread(&ParticleRecorder::WriterLoop, this);
+	return true;
+}
+
+void ParticleRecorder::Close()
+{
+	if (INVALID_HANDLE_VALUE == file)
+		return;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		closing = true;
+	}
+	wake.notify_one();
+	writer.join();
+
+	CloseHandle(file);
+	file = INVALID_HANDLE_VALUE;
+
+	for (auto iFrame = frames.begin(); iFrame != frames.end(); ++iFrame)
+		delete *iFrame;
+	frames.clear();
+	freeFrames.clear();
+	queue.clear();
+	acquired = nullptr;
+}
+
+Particle * ParticleRecorder::Acquire(uint32_t frame)
+{
+	assert(nullptr == acquired);
+
+	std::unique_lock<std::mutex> guard(lock);
+	if (desc.lossless)
+		frameFreed.wait(guard, [this] { return !freeFrames.empty(); });
+
+	if (freeFrames.empty())
+	{
+		stats.framesSkipped++;
+		return nullptr;
+	}
+
+	acquired = freeFrames.back();
+	freeFrames.pop_back();
+	acquired->frame = frame;
+	return acquired->particles.data();
+}
+
+void ParticleRecorder::Submit(Particle * particles)
+{
+	assert(nullptr != acquired && acquired->particles.data() == particles);
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		queue.push_back(acquired);
+	}
+	wake.notify_one();
+	acquired = nullptr;
+}
+
+void ParticleRecorder::Skip()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	stats.framesSkipped++;
+}
+
+ParticleRecorderStats ParticleRecorder::GetStats()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return stats;
+}
+
+void ParticleRecorder::WriterLoop()
+{
+	// next to the frames it encodes; on a node without processors it
+	// just runs wherever
+	HostPinThread(node);
+
+	for (;;)
+	{
+		Frame* frame = nullptr;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [this] { return closing || !queue.empty(); });
+			if (queue.empty())
+				return;
+
+			frame = queue.front();
+			queue.erase(queue.begin());
+		}
+
+		// stats.framesWritten is only ever changed on this thread
+		bool keyframe = 0 == stats.framesWritten % desc.keyframeInterval;
+		Encode(*frame, keyframe);
+
+		ParticleRecordingFrame record = {};
+		record.frame = frame->frame;
+		record.byteCount = (uint32_t)encoded.size();
+		record.keyframe = keyframe;
+
+		DWORD written = 0, writtenData = 0;
+		WriteFile(file, &record, sizeof(record), &written, nullptr);
+		WriteFile(file, encoded.data(), record.byteCount, &writtenData, nullptr);
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			freeFrames.push_back(frame);
+			stats.framesWritten++;
+			stats.bytesWritten += written + writtenData;
+		}
+		frameFreed.notify_one();
+	}
+}
+
+static void PutVarint(std::vector<uint8_t>& out, uint32_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((uint8_t)value);
+}
+
+static int32_t Quantize(float value, float step)
+{
+	float q = floorf(value / step + 0.5f);
+	return q >= 2147483647.0f ? INT32_MAX : (q <= -2147483648.0f ? INT32_MIN : (int32_t)q);
+}
+
+void ParticleRecorder::Encode(const Frame & frame, bool keyframe)
+{
+	encoded.clear();
+
+	if (keyframe)
+		std::fill(previous.begin(), previous.end(), 0);
+
+	for (uint32_t field = 0; field < PARTICLE_RECORDING_FIELDS; ++field)
+	{
+		int32_t* last = &previous[field * particleCount];
+		uint32_t zeros = 0;
+
+		for (uint32_t i = 0; i < particleCount; ++i)
+		{
+			const Particle& p = frame.particles[i];
+
+			int32_t q;
+			switch (field)
+			{
+			case 0: q = Quantize(p.position.x, desc.positionStep); break;
+			case 1: q = Quantize(p.position.y, desc.positionStep); break;
+			case 2: q = Quantize(p.position.z, desc.positionStep); break;
+			case 3: q = Quantize(p.age, desc.ageStep); break;
+			case 4: q = Quantize(p.velocity.x, desc.velocityStep); break;
+			case 5: q = Quantize(p.velocity.y, desc.velocityStep); break;
+			case 6: q = Quantize(p.velocity.z, desc.velocityStep); break;
+			default: q = (int32_t)p.emitter; break;
+			}
+
+			// wrapping difference, then zigzag so small negatives stay small
+			int32_t delta = (int32_t)((uint32_t)q - (uint32_t)last[i]);
+			uint32_t zigzag = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+			last[i] = q;
+
+			if (0 == zigzag)
+			{
+				zeros++;
+				continue;
+			}
+
+			if (zeros > 0)
+			{
+				PutVarint(encoded, 0);
+				PutVarint(encoded, zeros - 1);
+				zeros = 0;
+			}
+			PutVarint(encoded, zigzag);
+		}
+
+		// runs don't cross fields
+		if (zeros > 0)
+		{
+			PutVarint(encoded, 0);
+			PutVarint(encoded, zeros - 1);
+		}
+	}
+}
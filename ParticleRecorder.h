@@ -0,0 +1,145 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "HostMemory.h"
+#include "Particle.h"
+
+// File layout written by ParticleRecorder: a ParticleRecordingHeader, then
+// for every recorded frame a ParticleRecordingFrame followed by byteCount
+// bytes of encoded particle state.
+//
+// Each particle field is quantized to an integer (the steps are in the
+// header; emitter ids are kept as they are), then replaced by its
+// difference to the same slot in the previous recorded frame, or to zero
+// in keyframes, and zigzag mapped to unsigned. The fields are written one after another for all
+// slots (every position.x, then every position.y, ...) as LEB128 varints,
+// where a zero is followed by a varint count of further zeros. Slots that
+// did not change, dead ones included, thus cost a few bits each
+#define PARTICLE_RECORDING_MAGIC	0x43455250	// "PREC"
+#define PARTICLE_RECORDING_VERSION	2
+#define PARTICLE_RECORDING_FIELDS	8
+
+struct ParticleRecordingHeader
+{
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	particleCount;
+	float		positionStep;
+	float		velocityStep;
+	float		ageStep;
+};
+
+struct ParticleRecordingFrame
+{
+	uint32_t	frame;		// frames skipped for lack of time show up as gaps
+	uint32_t	byteCount;
+	uint32_t	keyframe;	// decodes without the frames before it
+	uint32_t	_padding;
+};
+
+struct ParticleRecorderDesc
+{
+	// quantization steps: world units, world units per second, seconds
+	float							positionStep;
+	float							velocityStep;
+	float							ageStep;
+
+	// frames waiting to be encoded before new ones are skipped
+	uint32_t						queueFrames;
+
+	// every this many written frames is a keyframe, where playback can
+	// start without decoding what came before
+	uint32_t						keyframeInterval;
+
+	// wait for the GPU and the writer instead of skipping frames, for
+	// offline bakes where every frame matters more than the frame rate
+	bool							lossless;
+
+	// NUMA node the writer thread is pinned to and its frames live on
+	uint32_t						hostNode;
+
+	ParticleRecorderDesc()
+		:
+		positionStep(1.0f / 1024),
+		velocityStep(1.0f / 256),
+		ageStep(1.0f / 1000),
+		queueFrames(4),
+		keyframeInterval(60),
+		lossless(false),
+		hostNode(HOST_NODE_ANY)
+	{}
+};
+
+struct ParticleRecorderStats
+{
+	uint32_t						framesWritten;
+	uint32_t						framesSkipped;	// queue full or readback not back in time
+	uint64_t						bytesWritten;
+};
+
+// Encodes and writes frames of particle state on its own thread. The
+// producer side never blocks: with the queue full a frame is skipped,
+// unless the recording is lossless
+class ParticleRecorder
+{
+public:
+	ParticleRecorder();
+	~ParticleRecorder();
+
+	bool Open(const std::wstring& fileName, uint32_t particleCount, const ParticleRecorderDesc& desc);
+
+	// Finishes the frames already queued, then closes the file
+	void Close();
+
+	// A buffer of particleCount particles to fill with frame `frame`, or
+	// null if the queue is full (lossless recordings wait for the writer
+	// instead). Pass it to Submit once filled
+	Particle* Acquire(uint32_t frame);
+	void Submit(Particle* particles);
+
+	// Counts a frame that never made it to Acquire
+	void Skip();
+
+	ParticleRecorderStats GetStats();
+
+private:
+	typedef std::vector<Particle, HostAllocator<Particle>>	ParticleArray;
+	typedef std::vector<int32_t, HostAllocator<int32_t>>	FieldArray;
+
+	struct Frame
+	{
+		ParticleArray				particles;
+		uint32_t					frame;
+	};
+
+	void WriterLoop();
+	void Encode(const Frame& frame, bool keyframe);
+
+	void*							file;		// HANDLE
+	uint32_t						particleCount;
+	ParticleRecorderDesc			desc;
+	uint32_t						node;		// desc.hostNode resolved
+
+	std::thread						writer;
+	std::mutex						lock;
+	std::condition_variable			wake;
+	std::condition_variable			frameFreed;	// lossless only
+	bool							closing;
+
+	std::vector<Frame*>				frames;		// all of them, owned
+	std::vector<Frame*>				freeFrames;
+	std::vector<Frame*>				queue;		// submitted, oldest first
+	Frame*							acquired;
+
+	// writer thread only
+	FieldArray						previous;	// quantized fields of the last written frame, field-major
+	std::vector<uint8_t>			encoded;
+
+	ParticleRecorderStats			stats;
+};
\ No newline at end of file
@@ -0,0 +1,27 @@
+#ifndef _PARTICLE_RECYCLE_
+#define _PARTICLE_RECYCLE_
+
+#include "ShaderCommon.h"
+
+// OVERFLOW_RECYCLE overwrites the live particles that have used up the
+// largest fraction of their life. Before a frame's spawns, a histogram of
+// that fraction in RECYCLE_BUCKETS steps picks as many of them as the
+// spawns could overflow; within the last bucket taken the pick is arbitrary.
+//
+// OVERFLOW_STEAL buckets by the priority rank of the particle's emitter
+// instead and lists the victims sorted by it, lowest first. Each bucket's
+// counter ends up at the end of its victims, so an emitter of rank r can
+// claim the victims before counters[r - 1], which all belong to emitters
+// of lower priority. Ranks past the last bucket share it
+#define RECYCLE_BUCKETS				256
+
+// Slots of the recycle counter buffer, after one count per bucket
+#define RECYCLE_COUNTER_THRESHOLD	(RECYCLE_BUCKETS + 0)	// youngest bucket giving up particles
+#define RECYCLE_COUNTER_TAKE		(RECYCLE_BUCKETS + 1)	// how many of that bucket's go
+#define RECYCLE_COUNTER_TAKEN		(RECYCLE_BUCKETS + 2)
+#define RECYCLE_COUNTER_GROUPS_DONE	(RECYCLE_BUCKETS + 3)
+#define RECYCLE_COUNTER_VICTIMS		(RECYCLE_BUCKETS + 4)	// particles listed
+#define RECYCLE_COUNTER_CLAIMED		(RECYCLE_BUCKETS + 5)	// of those, handed to spawns so far
+#define RECYCLE_COUNTER_COUNT		(RECYCLE_BUCKETS + 6)
+
+#endif
\ No newline at end of file
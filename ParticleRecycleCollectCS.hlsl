@@ -0,0 +1,55 @@
+#include "Particle.h"
+#include "ParticleVictims.hlsli"
+
+StructuredBuffer<Particle> particles : register(t0);
+
+RWStructuredBuffer<uint> counters : register(u0);
+RWStructuredBuffer<uint> victims : register(u1);
+
+cbuffer Constants : register(b0)
+{
+	uint	count;
+	uint	victimCount;	// OVERFLOW_STEAL lists only the lowest ranks' first victimCount
+	uint	overflowPolicy;
+	uint	_padding;
+}
+
+// Lists the particles older than the threshold ParticleRecycleHistogramCS
+// found, and as many as it said of the ones in the threshold bucket. For
+// OVERFLOW_STEAL, places every particle in its rank's part of the list
+[numthreads(1024, 1, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+	if (DTid.x >= count)
+		return;
+
+	Particle p = particles[DTid.x];
+	if (p.emitter == PARTICLE_DEAD)
+		return;
+
+	uint bucket = VictimBucket(p, overflowPolicy);
+	uint slot;
+
+	if (overflowPolicy == OVERFLOW_STEAL)
+	{
+		InterlockedAdd(counters[bucket], 1, slot);
+		if (slot < victimCount)
+			victims[slot] = DTid.x;
+		return;
+	}
+
+	uint threshold = counters[RECYCLE_COUNTER_THRESHOLD];
+	if (bucket < threshold)
+		return;
+
+	if (bucket == threshold)
+	{
+		uint taken;
+		InterlockedAdd(counters[RECYCLE_COUNTER_TAKEN], 1, taken);
+		if (taken >= counters[RECYCLE_COUNTER_TAKE])
+			return;
+	}
+
+	InterlockedAdd(counters[RECYCLE_COUNTER_VICTIMS], 1, slot);
+	victims[slot] = DTid.x;
+}
\ No newline at end of file
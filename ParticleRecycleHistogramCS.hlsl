@@ -0,0 +1,77 @@
+#include "Particle.h"
+#include "ParticleVictims.hlsli"
+
+StructuredBuffer<Particle> particles : register(t0);
+
+RWStructuredBuffer<uint> counters : register(u0);
+
+cbuffer Constants : register(b0)
+{
+	uint	count;			// slots [0, count) can be recycled
+	uint	victimCount;	// particles to pick, the most this frame's spawns can overflow
+	uint	groupCount;
+	uint	overflowPolicy;
+}
+
+groupshared uint gsHistogram[RECYCLE_BUCKETS];
+
+// Counts the live particles per bucket, see ParticleRecycle.h. The last
+// group to finish then walks the buckets from the oldest down to find
+// where the victimCount oldest particles end, or for OVERFLOW_STEAL turns
+// the counts into where each rank's victims start
+[numthreads(1024, 1, 1)]
+void main(uint3 DTid : SV_DispatchThreadID, uint GI : SV_GroupIndex)
+{
+	if (GI < RECYCLE_BUCKETS)
+		gsHistogram[GI] = 0;
+	GroupMemoryBarrierWithGroupSync();
+
+	if (DTid.x < count)
+	{
+		Particle p = particles[DTid.x];
+		if (p.emitter != PARTICLE_DEAD)
+			InterlockedAdd(gsHistogram[VictimBucket(p, overflowPolicy)], 1);
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	if (GI < RECYCLE_BUCKETS && gsHistogram[GI] > 0)
+		InterlockedAdd(counters[GI], gsHistogram[GI]);
+	DeviceMemoryBarrierWithGroupSync();
+
+	if (GI != 0)
+		return;
+
+	uint done;
+	InterlockedAdd(counters[RECYCLE_COUNTER_GROUPS_DONE], 1, done);
+	if (done != groupCount - 1)
+		return;
+
+	if (overflowPolicy == OVERFLOW_STEAL)
+	{
+		uint start = 0;
+		for (uint b = 0; b < RECYCLE_BUCKETS; ++b)
+		{
+			uint n;
+			InterlockedExchange(counters[b], start, n);
+			start += n;
+		}
+
+		counters[RECYCLE_COUNTER_VICTIMS] = min(start, victimCount);
+		return;
+	}
+
+	uint threshold = 0;
+	uint take = 0;
+	uint remaining = victimCount;
+	for (uint b = RECYCLE_BUCKETS; b > 0 && remaining > 0; --b)
+	{
+		uint n;
+		InterlockedAdd(counters[b - 1], 0, n);
+		threshold = b - 1;
+		take = min(n, remaining);
+		remaining -= take;
+	}
+
+	counters[RECYCLE_COUNTER_THRESHOLD] = threshold;
+	counters[RECYCLE_COUNTER_TAKE] = take;
+}
\ No newline at end of file
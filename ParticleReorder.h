@@ -0,0 +1,15 @@
+#ifndef _PARTICLE_REORDER_
+#define _PARTICLE_REORDER_
+
+#include "ShaderCommon.h"
+
+// Sort keys of the Morton reorder pass. Each entry is (key, slot); live
+// particles get a 30-bit Morton code, so dead slots and the power-of-two
+// padding always sort behind them.
+#define REORDER_KEY_DEAD		0xFFFFFFFE
+#define REORDER_KEY_PAD			0xFFFFFFFF
+
+// Bits of cell coordinate per axis, centered on the origin
+#define REORDER_AXIS_BITS		10
+
+#endif
\ No newline at end of file
@@ -0,0 +1,31 @@
+#include "Particle.h"
+
+StructuredBuffer<Particle> particles : register(t0);
+StructuredBuffer<uint2> keys : register(t1);
+
+RWStructuredBuffer<Particle> sorted : register(u0);
+
+AppendStructuredBuffer<uint> deadList : register(u1);
+
+cbuffer Constants : register(b0)
+{
+	uint	count;
+	uint3	_padding;
+}
+
+// Gathers particles in key order and rebuilds the dead list to match.
+// Keys may be a few frames old when the sort is time-sliced, so liveness
+// is checked again on the particle itself rather than taken from the key.
+[numthreads(1024, 1, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+	uint i = DTid.x;
+	if (i >= count)
+		return;
+
+	Particle p = particles[keys[i].y];
+	sorted[i] = p;
+
+	if (p.emitter == PARTICLE_DEAD)
+		deadList.Append(i);
+}
\ No newline at end of file
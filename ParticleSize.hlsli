@@ -0,0 +1,20 @@
+#ifndef _PARTICLE_SIZE_
+#define _PARTICLE_SIZE_
+
+#include "EmitterParams.h"
+
+// World size of a particle's quad, from its emitter's size over its life
+float ParticleSize(float age, EmitterParams params)
+{
+	return lerp(params.size, params.sizeEnd, saturate(age / params.lifeTime));
+}
+
+// Whether a quad of this world size, this far in front of the camera,
+// covers fewer than minPixels pixels. pixelScale turns size over depth into
+// pixels; minPixels <= 0 culls nothing
+bool IsSubPixel(float size, float depth, float pixelScale, float minPixels)
+{
+	return minPixels > 0 && depth > 0 && size * pixelScale < minPixels * depth;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,265 @@
+#include "ParticleSystem.h"
+#include "ParticleSnapshot.h"
+#include "Particle.h"
+#include "ParticleBitset.h"
+
+#include <windows.h>
+
+#include <cassert>
+
+// Reads a whole GPU buffer back through a temporary staging copy
+static bool WriteBuffer(ID3D11Device* device, ID3D11DeviceContext* context, ID3D11Buffer* buffer, HANDLE file)
+{
+	D3D11_BUFFER_DESC desc;
+	buffer->GetDesc(&desc);
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	desc.MiscFlags = 0;
+	desc.StructureByteStride = 0;
+
+	ID3D11Buffer* staging = nullptr;
+	HRESULT hr = device->CreateBuffer(&desc, nullptr, &staging);
+	assert(hr == S_OK);
+
+	context->CopyResource(staging, buffer);
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	hr = context->Map(staging, 0, D3D11_MAP_READ, 0, &mapped);
+	assert(hr == S_OK);
+
+	DWORD written = 0;
+	BOOL ok = WriteFile(file, mapped.pData, desc.ByteWidth, &written, nullptr);
+
+	context->Unmap(staging, 0);
+	staging->Release();
+
+	return ok && written == desc.ByteWidth;
+}
+
+// Hidden counter of an append/consume buffer
+static uint32_t ReadStructureCount(ID3D11Device* device, ID3D11DeviceContext* context, ID3D11UnorderedAccessView* uav)
+{
+	CD3D11_BUFFER_DESC desc(sizeof(uint32_t), 0, D3D11_USAGE_STAGING, D3D11_CPU_ACCESS_READ);
+
+	ID3D11Buffer* staging = nullptr;
+	HRESULT hr = device->CreateBuffer(&desc, nullptr, &staging);
+	assert(hr == S_OK);
+
+	context->CopyStructureCount(staging, 0, uav);
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	hr = context->Map(staging, 0, D3D11_MAP_READ, 0, &mapped);
+	assert(hr == S_OK);
+
+	uint32_t count = *reinterpret_cast<uint32_t*>(mapped.pData);
+
+	context->Unmap(staging, 0);
+	staging->Release();
+
+	return count;
+}
+
+static bool WriteData(HANDLE file, const void* data, size_t bytes)
+{
+	DWORD written = 0;
+	return WriteFile(file, data, (DWORD)bytes, &written, nullptr) && written == bytes;
+}
+
+static ParticleSnapshotChunk DescribeChunk(const ParticlePool& pool)
+{
+	ParticleSnapshotChunk chunk = {};
+	chunk.maxParticles = pool.particleConstants.maxParticles;
+	chunk.emitterCount = (uint32_t)pool.emitters.size();
+	chunk.hasDeadList = nullptr != pool.bufDeadList;
+	if (nullptr != pool.bufOccupancy)
+	{
+		uint32_t blocks = (chunk.maxParticles + BITSET_BLOCK_SLOTS - 1) / BITSET_BLOCK_SLOTS;
+		chunk.occupancyWords = blocks * BITSET_WORDS_PER_BLOCK;
+		chunk.blockFullWords = (blocks + BITSET_WORD_BITS - 1) / BITSET_WORD_BITS;
+	}
+	return chunk;
+}
+
+bool ParticleSystem::SaveSnapshot(const std::wstring & fileName)
+{
+	HANDLE file = CreateFileW(fileName.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (INVALID_HANDLE_VALUE == file)
+		return false;
+
+	ParticleSnapshotHeader header = {};
+	header.magic = PARTICLE_SNAPSHOT_MAGIC;
+	header.version = PARTICLE_SNAPSHOT_VERSION;
+	header.chunkCount = (uint32_t)pools.size();
+	header.particleSize = sizeof(Particle);
+
+	bool ok = WriteData(file, &header, sizeof(header));
+
+	for (auto iPool = pools.begin(); ok && iPool != pools.end(); ++iPool)
+	{
+		ParticlePool& pool = *iPool;
+
+		ParticleSnapshotChunk chunk = DescribeChunk(pool);
+		chunk.deadCount = chunk.hasDeadList ? ReadStructureCount(device, context, pool.bufDeadListUAV) : 0;
+		chunk.drawCount = ReadStructureCount(device, context, pool.bufDrawListUAV);
+		chunk.ringStart = pool.particleConstants.ringStart;
+		chunk.statelessHead = pool.statelessHead;
+		chunk.particleFirstUpdate = pool.particleFirstUpdate;
+
+		ok = WriteData(file, &chunk, sizeof(chunk))
+			&& WriteData(file, pool.emitters.data(), pool.emitters.size() * sizeof(Emitter))
+			&& WriteData(file, pool.emitterParams.data(), pool.emitterParams.size() * sizeof(EmitterParams))
+			&& WriteData(file, pool.emitterTransforms.data(), pool.emitterTransforms.size() * sizeof(DirectX::XMFLOAT4X4))
+			&& WriteBuffer(device, context, pool.bufParticles, file)
+			&& (!chunk.hasDeadList || WriteBuffer(device, context, pool.bufDeadList, file))
+			&& WriteBuffer(device, context, pool.bufDrawList, file)
+			&& WriteBuffer(device, context, pool.bufStats, file)
+			&& (0 == chunk.occupancyWords || WriteBuffer(device, context, pool.bufOccupancy, file))
+			&& (0 == chunk.blockFullWords || WriteBuffer(device, context, pool.bufBlockFull, file));
+	}
+
+	CloseHandle(file);
+	return ok;
+}
+
+bool ParticleSystem::LoadSnapshot(const std::wstring & fileName)
+{
+	HANDLE file = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (INVALID_HANDLE_VALUE == file)
+		return false;
+
+	LARGE_INTEGER fileSize = {};
+	GetFileSizeEx(file, &fileSize);
+
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const uint8_t* view = nullptr != mapping ? static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+	if (nullptr == view)
+	{
+		if (nullptr != mapping)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	const uint8_t* end = view + fileSize.QuadPart;
+	const uint8_t* cursor = view;
+
+	// hands out the next `bytes` of the file, or null past its end
+	auto take = [&cursor, end](size_t bytes) -> const uint8_t*
+	{
+		if ((size_t)(end - cursor) < bytes)
+			return nullptr;
+		const uint8_t* data = cursor;
+		cursor += bytes;
+		return data;
+	};
+
+	const ParticleSnapshotHeader* header = reinterpret_cast<const ParticleSnapshotHeader*>(take(sizeof(ParticleSnapshotHeader)));
+	bool ok = nullptr != header
+		&& header->magic == PARTICLE_SNAPSHOT_MAGIC
+		&& header->version == PARTICLE_SNAPSHOT_VERSION
+		&& header->chunkCount == pools.size()
+		&& header->particleSize == sizeof(Particle);
+
+	// the whole file is checked against the pools before anything is
+	// uploaded, so a mismatched snapshot leaves every pool untouched
+	struct ChunkData
+	{
+		const ParticleSnapshotChunk*	chunk;
+		const uint8_t*					emitters;
+		const uint8_t*					params;
+		const uint8_t*					transforms;
+		const uint8_t*					particles;
+		const uint8_t*					deadList;
+		const uint8_t*					drawList;
+		const uint8_t*					stats;
+		const uint8_t*					occupancy;
+		const uint8_t*					blockFull;
+	};
+	std::vector<ChunkData> chunks;
+
+	for (auto iPool = pools.begin(); ok && iPool != pools.end(); ++iPool)
+	{
+		ParticleSnapshotChunk expected = DescribeChunk(*iPool);
+
+		ChunkData data = {};
+		data.chunk = reinterpret_cast<const ParticleSnapshotChunk*>(take(sizeof(ParticleSnapshotChunk)));
+		ok = nullptr != data.chunk
+			&& data.chunk->maxParticles == expected.maxParticles
+			&& data.chunk->emitterCount == expected.emitterCount
+			&& data.chunk->hasDeadList == expected.hasDeadList
+			&& data.chunk->occupancyWords == expected.occupancyWords
+			&& data.chunk->blockFullWords == expected.blockFullWords;
+		if (!ok)
+			break;
+
+		data.emitters = take(expected.emitterCount * sizeof(Emitter));
+		data.params = take(expected.emitterCount * sizeof(EmitterParams));
+		data.transforms = take(expected.emitterCount * sizeof(DirectX::XMFLOAT4X4));
+		data.particles = take(expected.maxParticles * sizeof(Particle));
+		data.deadList = take(expected.hasDeadList ? expected.maxParticles * sizeof(uint32_t) : 0);
+		data.drawList = take(expected.maxParticles * sizeof(uint32_t));
+		data.stats = take(PARTICLE_STAT_COUNT * sizeof(uint32_t));
+		data.occupancy = take(expected.occupancyWords * sizeof(uint32_t));
+		data.blockFull = take(expected.blockFullWords * sizeof(uint32_t));
+
+		ok = nullptr != data.emitters && nullptr != data.params && nullptr != data.transforms
+			&& nullptr != data.particles && nullptr != data.deadList && nullptr != data.drawList
+			&& nullptr != data.stats && nullptr != data.occupancy && nullptr != data.blockFull;
+
+		chunks.push_back(data);
+	}
+
+	for (uint32_t i = 0; ok && i < chunks.size(); ++i)
+	{
+		ParticlePool& pool = pools[i];
+		const ChunkData& data = chunks[i];
+
+		const Emitter* emitters = reinterpret_cast<const Emitter*>(data.emitters);
+		const EmitterParams* params = reinterpret_cast<const EmitterParams*>(data.params);
+		const DirectX::XMFLOAT4X4* transforms = reinterpret_cast<const DirectX::XMFLOAT4X4*>(data.transforms);
+		pool.emitters.assign(emitters, emitters + data.chunk->emitterCount);
+		pool.emitterParams.assign(params, params + data.chunk->emitterCount);
+		pool.emitterTransforms.assign(transforms, transforms + data.chunk->emitterCount);
+		pool.emitterParamsDirty = true;
+		pool.emitterTransformsDirty = true;
+		pool.emitOrderDirty = true;
+
+		pool.particleConstants.ringStart = data.chunk->ringStart;
+		pool.statelessHead = data.chunk->statelessHead;
+		pool.particleFirstUpdate = 0 != data.chunk->particleFirstUpdate;
+
+		// a sort in flight was over the particles that just got replaced
+		pool.reorderStride = 0;
+		pool.reorderFrames = 0;
+		pool.reorderSinceSort = PROFILE_REORDER_FRAMES;
+
+		context->UpdateSubresource(pool.bufParticles, 0, nullptr, data.particles, 0, 0);
+		if (data.chunk->hasDeadList)
+			context->UpdateSubresource(pool.bufDeadList, 0, nullptr, data.deadList, 0, 0);
+		context->UpdateSubresource(pool.bufDrawList, 0, nullptr, data.drawList, 0, 0);
+		context->UpdateSubresource(pool.bufStats, 0, nullptr, data.stats, 0, 0);
+		if (data.chunk->occupancyWords > 0)
+			context->UpdateSubresource(pool.bufOccupancy, 0, nullptr, data.occupancy, 0, 0);
+		if (data.chunk->blockFullWords > 0)
+			context->UpdateSubresource(pool.bufBlockFull, 0, nullptr, data.blockFull, 0, 0);
+
+		// binding an append view with an initial count is the only way to
+		// set its hidden counter. Before the first update the dead list
+		// counter is still to be set by EmitParticles
+		ID3D11UnorderedAccessView* uavs[] = { pool.bufDrawListUAV, pool.bufDeadListUAV };
+		uint32_t counts[] = { data.chunk->drawCount, data.chunk->deadCount };
+		uint32_t uavCount = data.chunk->hasDeadList && !pool.particleFirstUpdate ? 2 : 1;
+		context->CSSetUnorderedAccessViews(0, uavCount, uavs, counts);
+
+		ID3D11UnorderedAccessView* nulls[] = { nullptr, nullptr };
+		uint32_t keep[] = { D3D11_KEEP_UNORDERED_ACCESS_VIEWS, D3D11_KEEP_UNORDERED_ACCESS_VIEWS };
+		context->CSSetUnorderedAccessViews(0, 2, nulls, keep);
+	}
+
+	UnmapViewOfFile(view);
+	CloseHandle(mapping);
+	CloseHandle(file);
+
+	return ok;
+}
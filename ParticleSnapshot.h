@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+// On-disk layout written by ParticleSystem::SaveSnapshot. A header, then one
+// chunk record per pool chunk in creation order, each followed by its data:
+//
+//   Emitter[emitterCount], EmitterParams[emitterCount], XMFLOAT4X4[emitterCount]
+//   Particle[maxParticles]
+//   uint32_t[maxParticles] dead list, if hasDeadList
+//   uint32_t[maxParticles] draw list
+//   uint32_t[PARTICLE_STAT_COUNT] stats
+//   uint32_t[occupancyWords] occupancy, uint32_t[blockFullWords] block summary
+//
+// Every array is stored exactly as it sits in its GPU buffer, so a restore
+// is one upload per buffer straight out of the mapped file
+#define PARTICLE_SNAPSHOT_MAGIC		0x504E5350	// "PSNP"
+#define PARTICLE_SNAPSHOT_VERSION	4
+
+struct ParticleSnapshotHeader
+{
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	chunkCount;
+	uint32_t	particleSize;	// sizeof(Particle), guards against layout changes
+};
+
+struct ParticleSnapshotChunk
+{
+	uint32_t	maxParticles;
+	uint32_t	emitterCount;
+	uint32_t	hasDeadList;
+	uint32_t	occupancyWords;	// 0 unless a bitset pool
+	uint32_t	blockFullWords;
+	uint32_t	deadCount;		// hidden counters of the append buffers
+	uint32_t	drawCount;
+	uint32_t	ringStart;
+	uint32_t	statelessHead;
+	uint32_t	particleFirstUpdate;
+	uint32_t	_padding[2];
+};
\ No newline at end of file
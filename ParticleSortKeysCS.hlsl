@@ -0,0 +1,53 @@
+#include "Particle.h"
+#include "ParticleReorder.h"
+
+StructuredBuffer<Particle> particles : register(t0);
+
+RWStructuredBuffer<uint2> keys : register(u0);
+
+cbuffer Constants : register(b0)
+{
+	uint	count;			// slots taking part in the sort
+	uint	paddedCount;	// count rounded up to a power of two
+	float	cellSize;
+	uint	_padding;
+}
+
+// inserts two zero bits between each of the low 10 bits
+uint SpreadBits(uint x)
+{
+	x &= 0x000003FF;
+	x = (x | (x << 16)) & 0xFF0000FF;
+	x = (x | (x << 8)) & 0x0300F00F;
+	x = (x | (x << 4)) & 0x030C30C3;
+	x = (x | (x << 2)) & 0x09249249;
+	return x;
+}
+
+[numthreads(1024, 1, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+	uint i = DTid.x;
+	if (i >= paddedCount)
+		return;
+
+	uint key = REORDER_KEY_PAD;
+	if (i < count)
+	{
+		Particle p = particles[i];
+		if (p.emitter == PARTICLE_DEAD)
+		{
+			key = REORDER_KEY_DEAD;
+		}
+		else
+		{
+			// coordinates outside the grid wrap around, which only costs
+			// some locality far from the origin
+			int3 cell = int3(floor(p.position / cellSize)) + (1 << (REORDER_AXIS_BITS - 1));
+			uint3 c = uint3(cell);
+			key = SpreadBits(c.x) | (SpreadBits(c.y) << 1) | (SpreadBits(c.z) << 2);
+		}
+	}
+
+	keys[i] = uint2(key, i);
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+RWStructuredBuffer<uint2> keys : register(u0);
+
+cbuffer Constants : register(b0)
+{
+	uint	paddedCount;
+	uint	blockSize;		// k: size of the sequences being merged
+	uint	stride;			// j: compare distance of this step
+	uint	_padding;
+}
+
+// One compare-and-swap step of a bitonic sort over the whole buffer
+[numthreads(1024, 1, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+	uint i = DTid.x;
+	uint partner = i ^ stride;
+	if (i >= paddedCount || partner <= i)
+		return;
+
+	uint2 a = keys[i];
+	uint2 b = keys[partner];
+
+	bool ascending = (i & blockSize) == 0;
+	if ((a.x > b.x) == ascending)
+	{
+		keys[i] = b;
+		keys[partner] = a;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef _PARTICLE_SPAWN_
+#define _PARTICLE_SPAWN_
+
+#include "Particle.h"
+#include "Noise.hlsli"
+#include "ParticleModules.hlsli"
+
+// spawnModules: length of the pool's spawn program, which starts at 0
+Particle SpawnParticle(float3 position, float3 velocity, uint emitter, float totalTime, uint spawnModules)
+{
+	Particle p;
+	p.position = position;
+	float3 randomFloat = curlNoise3D(p.position, totalTime);
+	p.position.xz += (randomFloat.xz % 10) / 100;
+	p.age = 0;
+	p.velocity = velocity;
+	p.emitter = emitter;
+	RunModules(p, 0, spawnModules, 0, totalTime);
+	return p;
+}
+
+// longest step of a prewarm that can't be done in closed form
+#define PREWARM_STEP (1.0 / 15.0)
+
+// Fast-forwards a newborn particle to `age` as if it had been simulated all
+// along: in one jump when only gravity acts on it, else in a few large
+// steps. Events it would have raised on the way are not reported
+void PrewarmParticle(inout Particle p, float age, float totalTime, uint spawnModules, uint updateModules)
+{
+	EmitterParams params = emitterParams[p.emitter];
+	if (params.drag == 0 && updateModules == 0)
+	{
+		p.position += p.velocity * age + 0.5 * params.gravity * age * age;
+		p.velocity += params.gravity * age;
+		p.age = age;
+		return;
+	}
+
+	uint steps = (uint)ceil(age / PREWARM_STEP);
+	float dt = age / steps;
+	for (uint i = 0; i < steps; ++i)
+	{
+		p.age += dt;
+		RunModules(p, spawnModules, updateModules, dt, totalTime - age + p.age);
+		IntegrateParticle(p, dt);
+	}
+}
+
+#endif
@@ -1,9 +1,16 @@
 #include "ParticleSystem.h"
 #include "Particle.h"
 #include "Emitter.h"
+#include "ParticleBitset.h"
+#include "ParticleRecycle.h"
+#include "ParticleReorder.h"
+#include "ParticleModules.h"
+#include "ParticleVertex.h"
 
 #include <WICTextureLoader.h>
 
+#include <algorithm>
+
 #include "FrameCapture.h"
 
 bool ParticleSystem::Init(ID3D11Device* device, ID3D11DeviceContext* context)
@@ -13,55 +20,115 @@ bool ParticleSystem::Init(ID3D11Device* device, ID3D11DeviceContext* context)
 	particleInitCS = new SimpleComputeShader(device, context);
 	assert(particleInitCS->LoadShaderFile(L"Assets/Shaders/ParticleInitCS.cso"));
 
-	particleCS = new SimpleComputeShader(device, context);
-	assert(particleCS->LoadShaderFile(L"Assets/Shaders/ParticleCS.cso"));
+	static const wchar_t* const featureSuffix[PARTICLE_FEATURE_MASKS] =
+	{
+		L"", L"Modules", L"Bitset", L"ModulesBitset",
+		L"Events", L"ModulesEvents", L"BitsetEvents", L"ModulesBitsetEvents"
+	};
+	for (uint32_t f = 0; f < PARTICLE_FEATURE_MASKS; ++f)
+	{
+		for (uint32_t i = 0; i < KERNEL_VARIANT_COUNT; ++i)
+		{
+			particleCS[f][i] = new SimpleComputeShader(device, context);
+			assert(particleCS[f][i]->LoadShaderFile((L"Assets/Shaders/ParticleCS" + std::wstring(featureSuffix[f]) + KERNEL_VARIANT_SUFFIX[i] + L".cso").c_str()));
+		}
+	}
+
+	for (uint32_t i = 0; i < KERNEL_VARIANT_COUNT; ++i)
+	{
+		particleEmitterCS[i] = new SimpleComputeShader(device, context);
+		assert(particleEmitterCS[i]->LoadShaderFile((L"Assets/Shaders/ParticleEmitterCS" + std::wstring(KERNEL_VARIANT_SUFFIX[i]) + L".cso").c_str()));
+	}
+
+	particleEmitterBitsetCS = new SimpleComputeShader(device, context);
+	assert(particleEmitterBitsetCS->LoadShaderFile(L"Assets/Shaders/ParticleEmitterBitsetCS.cso"));
+
+	particleFusedCS = new SimpleComputeShader(device, context);
+	assert(particleFusedCS->LoadShaderFile(L"Assets/Shaders/ParticleFusedCS.cso"));
+
+	particleSortKeysCS = new SimpleComputeShader(device, context);
+	assert(particleSortKeysCS->LoadShaderFile(L"Assets/Shaders/ParticleSortKeysCS.cso"));
 
-	particleEmitterCS = new SimpleComputeShader(device, context);
-	assert(particleEmitterCS->LoadShaderFile(L"Assets/Shaders/ParticleEmitterCS.cso"));
+	particleSortStepCS = new SimpleComputeShader(device, context);
+	assert(particleSortStepCS->LoadShaderFile(L"Assets/Shaders/ParticleSortStepCS.cso"));
+
+	particleReorderCS = new SimpleComputeShader(device, context);
+	assert(particleReorderCS->LoadShaderFile(L"Assets/Shaders/ParticleReorderCS.cso"));
+
+	particleRecycleHistogramCS = new SimpleComputeShader(device, context);
+	assert(particleRecycleHistogramCS->LoadShaderFile(L"Assets/Shaders/ParticleRecycleHistogramCS.cso"));
+
+	particleRecycleCollectCS = new SimpleComputeShader(device, context);
+	assert(particleRecycleCollectCS->LoadShaderFile(L"Assets/Shaders/ParticleRecycleCollectCS.cso"));
 
 	particleVS = new SimpleVertexShader(device, context);
 	assert(particleVS->LoadShaderFile(L"Assets/Shaders/ParticleVS.cso"));
 
+	particleExpandedVS = new SimpleVertexShader(device, context);
+	assert(particleExpandedVS->LoadShaderFile(L"Assets/Shaders/ParticleExpandedVS.cso"));
+
+	particleExpandCS = new SimpleComputeShader(device, context);
+	assert(particleExpandCS->LoadShaderFile(L"Assets/Shaders/ParticleExpandCS.cso"));
+
+	particleDrawArgsCS = new SimpleComputeShader(device, context);
+	assert(particleDrawArgsCS->LoadShaderFile(L"Assets/Shaders/ParticleDrawArgsCS.cso"));
+
 	particlePS = new SimplePixelShader(device, context);
 	assert(particlePS->LoadShaderFile(L"Assets/Shaders/ParticlePS.cso"));
 
 	{
 		CD3D11_BUFFER_DESC indicesDesc(
-			sizeof(uint32_t) * 6,
+			sizeof(uint32_t) * 6 * MAX_PARTICLE_INSTANCES,
 			D3D11_BIND_INDEX_BUFFER,
 			D3D11_USAGE_IMMUTABLE
 		);
 
-		uint32_t indices[] = { 0, 2, 3, 0, 3, 1 };
+		// one quad per copy of an instanced pool, four vertex ids apart so
+		// the vertex shader can tell the copies apart; others draw the first
+		const uint32_t quad[] = { 0, 2, 3, 0, 3, 1 };
+
+		std::vector<uint32_t> indices(6 * MAX_PARTICLE_INSTANCES);
+		for (uint32_t i = 0; i < indices.size(); ++i)
+			indices[i] = quad[i % 6] + 4 * (i / 6);
 
 		D3D11_SUBRESOURCE_DATA data = {};
-		data.pSysMem = indices;
+		data.pSysMem = indices.data();
 
 		hr = device->CreateBuffer(&indicesDesc, &data, &bufQuadIndices);
 		assert(hr == S_OK);
 	}
 
+	for (uint32_t i = 0; i < KERNEL_VARIANT_COUNT; ++i)
 	{
-		CD3D11_BUFFER_DESC indDrawDesc(
-			sizeof(uint32_t) * 8, // 5, but align with 16 bytes
-			D3D11_BIND_UNORDERED_ACCESS,
-			D3D11_USAGE_DEFAULT,
-			0,
-			D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS
-		);
+		auto info = particleEmitterCS[i]->GetBufferInfo("Emitter");
+		bufEmitter[i] = info->ConstantBuffer;
+	}
 
-		uint32_t args[] = { 6, 0, 0, 0, 0, 0, 0, 0 };
+	this->device = device;
+	this->context = context;
 
-		D3D11_SUBRESOURCE_DATA data = {};
-		data.pSysMem = args;
+	tuner.Init(device, context, L"ParticleKernels.cache");
+	drawTuner.Init(device, context, L"ParticleDraws.cache");
+	profiler.Init(device, context);
 
-		hr = device->CreateBuffer(&indDrawDesc, &data, &bufIndirectDrawArgs);
-		assert(hr == S_OK);
-	}
+	CreateCounterBuffer(max(BITSET_COUNTER_COUNT, FUSED_COUNTER_COUNT), &bufDispatchCounters, &bufDispatchCountersUAV);
+	CreateCounterBuffer(RECYCLE_COUNTER_COUNT, &bufRecycleCounters, &bufRecycleCountersUAV);
 
 	{
-		auto info = particleEmitterCS->GetBufferInfo("Emitter");
-		bufEmitter = info->ConstantBuffer;
+		CD3D11_BUFFER_DESC spawnDesc(
+			MAX_EMITTERS * sizeof(EmitterSpawn),
+			D3D11_BIND_SHADER_RESOURCE,
+			D3D11_USAGE_DYNAMIC,
+			D3D11_CPU_ACCESS_WRITE,
+			D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
+			sizeof(EmitterSpawn)
+		);
+
+		hr = device->CreateBuffer(&spawnDesc, nullptr, &bufEmitterSpawns);
+		assert(hr == S_OK);
+
+		hr = device->CreateShaderResourceView(bufEmitterSpawns, nullptr, &bufEmitterSpawnsSRV);
+		assert(hr == S_OK);
 	}
 
 	{
@@ -87,94 +154,446 @@ bool ParticleSystem::Init(ID3D11Device* device, ID3D11DeviceContext* context)
 		assert(hr == S_OK);
 	}
 
-	this->device = device;
-	this->context = context;
-
 	return true;
 }
 
 void ParticleSystem::Update(float deltaTime, float totalTime)
 {
+	tuner.BeginFrame();
+	if (profiling)
+	{
+		profiler.BeginFrame(landedTimings);
+		ApplyTimings();
+		profileAllFeatures = !profileAllFeatures;
+	}
+
+	this->totalTime = totalTime;
 	totalEmitCount = 0;
 	for (auto iPool = pools.begin(); iPool != pools.end(); ++iPool)
 	{
 		ParticlePool& pool = *iPool;
+
+		ReadBackStats(pool);
+		ReadBackEvents(pool, (uint32_t)(iPool - pools.begin()) - pool.chunkIndex);
+		if (!pool.hostEvents.empty())
+		{
+			// handlers may post the next batch while this one is delivered
+			eventScratch.swap(pool.hostEvents);
+			pool.hostEvents.clear();
+			DeliverEvents((uint32_t)(iPool - pools.begin()), eventScratch.data(), (uint32_t)eventScratch.size());
+		}
+		UploadEmitterParams(pool);
+		ReorderParticles(pool);
+
 		for (auto iEmitter = pool.emitters.begin(); iEmitter != pool.emitters.end(); ++iEmitter)
 		{
 			Emitter& emitter = *iEmitter;
 			emitter.counter += deltaTime * emitter.emitRate;
 			emitter.emitCount = static_cast<uint32_t>(emitter.counter); // floor of uint
 			emitter.counter -= emitter.emitCount;
+
+			// a prewarm replaces this frame's spawns with all the particles
+			// the emitter would have alive after running that long
+			emitter.prewarmAge = emitter.prewarmPending;
+			emitter.prewarmPending = 0.0f;
+			if (emitter.prewarmAge > 0.0f)
+				emitter.emitCount = static_cast<uint32_t>(emitter.emitRate * emitter.prewarmAge);
+
 			totalEmitCount += emitter.emitCount;
 		}
 	}
 
+	StreamPlayback(deltaTime);
+
 	if (totalEmitCount > 0)
 	{
 		FrameCapture::instance()->BeginCapture();
 
-		particleEmitterCS->SetShader();
-		particleEmitterCS->SetFloat("totalTime", totalTime);
+		for (auto iPool = pools.begin(); iPool != pools.end(); ++iPool)
+		{
+			EmitParticles(*iPool, totalTime);
+		}
+
+		FrameCapture::instance()->EndCapture();
+	}
 
+	if (!pools.empty())
+	{
 		for (auto iPool = pools.begin(); iPool != pools.end(); ++iPool)
 		{
 			ParticlePool& pool = *iPool;
-			particleEmitterCS->SetUnorderedAccessView("particles", pool.bufParticlesUAV);
 
-			for (auto iEmitter = pool.emitters.begin(); iEmitter != pool.emitters.end(); ++iEmitter)
+			if (pool.stateless)
+				continue;
+
+			if (pool.fusedUpdate)
+				SimulateFused(pool, deltaTime, totalTime);
+			else
+				SimulateParticles(pool, deltaTime, totalTime);
+
+			StageEvents(pool);
+		}
+
+		RecordFrames();
+		WriteDrawArgs();
+
+		ID3D11UnorderedAccessView* nulls[] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+		uint32_t initVals[] = { -1, -1, -1, -1, -1, -1, -1 };
+		context->CSSetUnorderedAccessViews(0, 7, nulls, initVals);
+
+		ID3D11ShaderResourceView* nullSRVs[] = { nullptr, nullptr, nullptr, nullptr };
+		context->CSSetShaderResources(0, 4, nullSRVs);
+	}
+
+	if (profiling)
+		profiler.EndFrame();
+	tuner.EndFrame();
+}
+
+void ParticleSystem::EmitParticles(ParticlePool & pool, float totalTime)
+{
+	// fused pools spawn inside their simulate pass
+	if (pool.fusedUpdate || pool.external)
+		return;
+
+	if (pool.emitOrderDirty)
+	{
+		pool.emitOrder.resize(pool.emitters.size());
+		for (uint32_t i = 0; i < pool.emitOrder.size(); ++i)
+			pool.emitOrder[i] = i;
+
+		// higher-priority emitters drain the dead list first, and then take
+		// the victims of the lowest ranks before anyone else can
+		if (pool.overflowPolicy == OVERFLOW_STEAL)
+		{
+			const ParticlePool::EmitterArray& emitters = pool.emitters;
+			std::stable_sort(pool.emitOrder.begin(), pool.emitOrder.end(),
+				[&emitters](uint32_t a, uint32_t b) { return emitters[a].priority > emitters[b].priority; });
+
+			// distinct priorities counted up from the lowest
+			pool.emitterRanks.assign(pool.emitters.size(), 0);
+			uint32_t rank = 0;
+			for (uint32_t i = (uint32_t)pool.emitOrder.size(); i-- > 0;)
+			{
+				if (i + 1 < pool.emitOrder.size() && emitters[pool.emitOrder[i]].priority != emitters[pool.emitOrder[i + 1]].priority)
+					++rank;
+				pool.emitterRanks[pool.emitOrder[i]] = min(rank, (uint32_t)RECYCLE_BUCKETS - 1);
+			}
+
+			if (nullptr != pool.bufEmitterRanks && !pool.emitterRanks.empty())
 			{
-				Emitter& emitter = *iEmitter;
-
-				if (0 == emitter.emitCount)
-					continue;
-
-				particleEmitterCS->SetFloat4("position", emitter.position);
-				particleEmitterCS->SetFloat4("velocity", emitter.velocity);
-				particleEmitterCS->SetInt("emitCount", emitter.emitCount);
-
-				if (pool.particleFirstUpdate)
-				{
-					particleEmitterCS->SetUnorderedAccessView("deadList", pool.bufDeadListUAV, pool.particleConstants.maxParticles);
-					particleEmitterCS->SetInt("deadParticles", pool.particleConstants.maxParticles);
-					particleEmitterCS->CopyAllBufferData();
-					pool.particleFirstUpdate = false;
-				}
-				else
-				{
-					particleEmitterCS->CopyAllBufferData();
-					particleEmitterCS->SetUnorderedAccessView("deadList", pool.bufDeadListUAV);
-					context->CopyStructureCount(bufEmitter, offsetof(Emitter, deadParticles), pool.bufDeadListUAV);
-				}
-
-				particleEmitterCS->DispatchByThreads(emitter.emitCount, 1, 1);
+				D3D11_BOX box = { 0, 0, 0, (UINT)(pool.emitterRanks.size() * sizeof(uint32_t)), 1, 1 };
+				context->UpdateSubresource(pool.bufEmitterRanks, 0, &box, pool.emitterRanks.data(), 0, 0);
 			}
 		}
+		pool.emitOrderDirty = false;
+	}
 
-		FrameCapture::instance()->EndCapture();
+	bool useBitset = pool.allocator == PARTICLE_ALLOCATOR_BITSET;
+
+	// UAV bindings are device state and every variant uses the same slots,
+	// so they are bound once here; the constants live per variant
+	SimpleComputeShader* bindCS = particleEmitterCS[0];
+
+	if (pool.particleFirstUpdate)
+	{
+		ReserveRings(pool);
+		bindCS->SetUnorderedAccessView("deadList", pool.bufDeadListUAV, pool.particleConstants.ringStart);
+		pool.particleFirstUpdate = false;
+	}
+	else
+	{
+		bindCS->SetUnorderedAccessView("deadList", pool.bufDeadListUAV);
 	}
 
-	if (!pools.empty())
+	// the most this frame's dead-list spawns could overflow
+	uint32_t overflowBound = 0;
+	for (auto iEmitter = pool.emitters.begin(); iEmitter != pool.emitters.end(); ++iEmitter)
 	{
-		particleCS->SetShader();
-		particleCS->SetFloat("deltaTime", deltaTime);
+		if (0 == iEmitter->ringSize)
+			overflowBound += iEmitter->emitCount;
+	}
+	PickRecycleVictims(pool, min(overflowBound, pool.particleConstants.ringStart));
 
-		for (auto iPool = pools.begin(); iPool != pools.end(); ++iPool)
+	bindCS->SetUnorderedAccessView("particles", pool.bufParticlesUAV);
+	bindCS->SetUnorderedAccessView("stats", pool.bufStatsUAV);
+	bindCS->SetUnorderedAccessView("recycleCounters", bufRecycleCountersUAV);
+	bindCS->SetShaderResourceView("victims", pool.bufRecycleListSRV);
+	bindCS->SetShaderResourceView("emitterParams", pool.bufEmitterParamsSRV);
+	BindModules(bindCS, pool);
+
+	for (auto iOrder = pool.emitOrder.begin(); iOrder != pool.emitOrder.end(); ++iOrder)
+	{
+		Emitter& emitter = pool.emitters[*iOrder];
+		if (0 == emitter.emitCount)
+			continue;
+
+		// stateless pools have no dead list, their emitters take turns
+		// spawning into one ring over the whole pool
+		if (pool.stateless)
 		{
-			ParticlePool& pool = *iPool;
+			emitter.ringBase = 0;
+			emitter.ringSize = pool.particleConstants.maxParticles;
+			emitter.ringHead = pool.statelessHead;
+		}
+
+		// more than a whole ring in one frame would only overwrite itself.
+		// More than the chunk holds could never all find a slot, so the rest
+		// is dropped here, which also keeps the dispatch within the group limit
+		uint32_t emitCount = min(emitter.emitCount, pool.particleConstants.maxParticles);
+		if (emitter.ringSize > 0)
+			emitCount = min(emitCount, emitter.ringSize);
+		else
+			pool.spawnsClamped += emitter.emitCount - emitCount;
+
+		// spawned by the bitset pass below
+		if (useBitset && 0 == emitter.ringSize)
+			continue;
+
+		uint32_t variant = tuner.Begin(TUNED_KERNEL_EMIT, emitCount);
+		SimpleComputeShader* cs = particleEmitterCS[variant];
+
+		cs->SetShader();
+		cs->SetFloat("totalTime", totalTime);
+		cs->SetInt("overflowPolicy", pool.overflowPolicy);
+		cs->SetInt("stealRank", pool.overflowPolicy == OVERFLOW_STEAL ? pool.emitterRanks[*iOrder] : 0);
+		cs->SetFloat4("position", emitter.position);
+		cs->SetFloat4("velocity", emitter.velocity);
+		cs->SetInt("ringBase", emitter.ringBase);
+		cs->SetInt("ringSize", emitter.ringSize);
+		cs->SetInt("ringHead", emitter.ringHead);
+		cs->SetInt("emitCount", emitCount);
+		cs->SetInt("emitterIndex", emitter.emitterIndex);
+		cs->SetInt("spawnModules", pool.spawnModules);
+		cs->SetInt("stateless", pool.stateless);
+		cs->SetInt("updateModules", pool.updateModules);
+		cs->SetFloat("prewarmAge", emitter.prewarmAge);
+		cs->CopyAllBufferData();
+
+		if (emitter.ringSize > 0)
+		{
+			cs->DispatchByThreads(emitCount, 1, 1);
+			tuner.End();
+
+			emitter.ringHead = (emitter.ringHead + emitCount) % emitter.ringSize;
+			if (pool.stateless)
+				pool.statelessHead = emitter.ringHead;
+			continue;
+		}
+
+		context->CopyStructureCount(bufEmitter[variant], offsetof(Emitter, deadParticles), pool.bufDeadListUAV);
+
+		cs->DispatchByThreads(emitCount, 1, 1);
+		tuner.End();
+	}
+
+	uint32_t blockCount = (pool.particleConstants.ringStart + BITSET_BLOCK_SLOTS - 1) / BITSET_BLOCK_SLOTS;
+	if (!useBitset || 0 == blockCount)
+		return;
+
+	// bitset pools always drop what doesn't fit; the other overflow
+	// policies need a dead list to know which slots are live
+	particleEmitterBitsetCS->SetShader();
+	particleEmitterBitsetCS->SetFloat("totalTime", totalTime);
+	particleEmitterBitsetCS->SetInt("ringStart", pool.particleConstants.ringStart);
+	particleEmitterBitsetCS->SetInt("blockCount", blockCount);
+	particleEmitterBitsetCS->SetInt("spawnModules", pool.spawnModules);
+	particleEmitterBitsetCS->SetInt("updateModules", pool.updateModules);
+	particleEmitterBitsetCS->SetUnorderedAccessView("particles", pool.bufParticlesUAV);
+	particleEmitterBitsetCS->SetUnorderedAccessView("occupancy", pool.bufOccupancyUAV);
+	particleEmitterBitsetCS->SetUnorderedAccessView("stats", pool.bufStatsUAV);
+	particleEmitterBitsetCS->SetUnorderedAccessView("blockFull", pool.bufBlockFullUAV);
+	particleEmitterBitsetCS->SetUnorderedAccessView("counters", bufDispatchCountersUAV);
+	particleEmitterBitsetCS->SetShaderResourceView("emitterParams", pool.bufEmitterParamsSRV);
+	BindModules(particleEmitterBitsetCS, pool);
+
+	for (auto iOrder = pool.emitOrder.begin(); iOrder != pool.emitOrder.end(); ++iOrder)
+	{
+		Emitter& emitter = pool.emitters[*iOrder];
+		if (0 == emitter.emitCount || emitter.ringSize > 0)
+			continue;
+
+		uint32_t zeros[4] = {};
+		context->ClearUnorderedAccessViewUint(bufDispatchCountersUAV, zeros);
+
+		particleEmitterBitsetCS->SetFloat4("position", emitter.position);
+		particleEmitterBitsetCS->SetFloat4("velocity", emitter.velocity);
+		particleEmitterBitsetCS->SetInt("emitCount", emitter.emitCount);
+		particleEmitterBitsetCS->SetInt("emitterIndex", emitter.emitterIndex);
+		particleEmitterBitsetCS->SetFloat("prewarmAge", emitter.prewarmAge);
+		particleEmitterBitsetCS->CopyAllBufferData();
+		particleEmitterBitsetCS->DispatchByThreads(blockCount, 1, 1);
+	}
+}
+
+void ParticleSystem::SimulateParticles(ParticlePool & pool, float deltaTime, float totalTime)
+{
+	// while profiling, every other frame runs the kernel with all the
+	// features compiled in, at the tuned group size, so the two can be
+	// compared. It does the same work, left out features being no-ops
+	uint32_t allFeatures = PARTICLE_FEATURE_MODULES | PARTICLE_FEATURE_EVENTS | (pool.features & PARTICLE_FEATURE_BITSET);
+	bool unspecialized = profiling && profileAllFeatures && pool.features != allFeatures;
+
+	uint32_t variant;
+	if (unspecialized)
+	{
+		int winner = tuner.GetWinner(TUNED_KERNEL_SIMULATE, pool.particleConstants.maxParticles);
+		variant = winner >= 0 ? winner : KERNEL_VARIANT_COUNT - 1;
+	}
+	else
+	{
+		variant = tuner.Begin(TUNED_KERNEL_SIMULATE, pool.particleConstants.maxParticles);
+	}
+	SimpleComputeShader* cs = particleCS[unspecialized ? allFeatures : pool.features][variant];
+
+	cs->SetShader();
+	cs->SetFloat("deltaTime", deltaTime);
+	cs->SetInt("maxParticles", pool.particleConstants.maxParticles);
+	cs->SetInt("ringStart", pool.particleConstants.ringStart);
+	cs->SetFloat("totalTime", totalTime);
+	cs->SetInt("spawnModules", pool.spawnModules);
+	cs->SetInt("updateModules", pool.updateModules);
+	cs->SetInt("eventMask", (pool.features & PARTICLE_FEATURE_EVENTS) ? pool.eventMask : 0);
+	cs->SetInt("eventCapacity", pool.eventCapacity);
+	SetCullConstants(cs, pool);
+	cs->SetUnorderedAccessView("particles", pool.bufParticlesUAV);
+	cs->SetUnorderedAccessView("deadList", pool.bufDeadListUAV);
+	cs->SetUnorderedAccessView("drawList", pool.bufDrawListUAV, 0);
+	cs->SetUnorderedAccessView("occupancy", pool.bufOccupancyUAV);
+	cs->SetUnorderedAccessView("blockFull", pool.bufBlockFullUAV);
+	cs->SetShaderResourceView("emitterParams", pool.bufEmitterParamsSRV);
+	BindModules(cs, pool);
+
+	if (pool.features & PARTICLE_FEATURE_EVENTS)
+	{
+		uint32_t zeros[4] = {};
+		context->ClearUnorderedAccessViewUint(pool.bufEventCountUAV, zeros);
+		cs->SetUnorderedAccessView("events", pool.bufEventsUAV);
+		cs->SetUnorderedAccessView("eventCount", pool.bufEventCountUAV);
+	}
+
+	cs->CopyAllBufferData();
 
-			particleCS->SetInt("maxParticles", pool.particleConstants.maxParticles);
-			particleCS->SetUnorderedAccessView("particles", pool.bufParticlesUAV);
-			particleCS->SetUnorderedAccessView("deadList", pool.bufDeadListUAV);
-			particleCS->SetUnorderedAccessView("drawList", pool.bufDrawListUAV, 0);
+	BeginProfile(pool, unspecialized ? PROFILE_ALL_FEATURES : ReorderProfileKind(pool));
+	cs->DispatchByThreads(pool.particleConstants.maxParticles, 1, 1);
+	profiler.End();
+
+	if (!unspecialized)
+		tuner.End();
+}
+
+void ParticleSystem::SimulateFused(ParticlePool & pool, float deltaTime, float totalTime)
+{
+	// tickets are handed out in emitter order, so a prefix sum over the
+	// emit counts tells each spawned slot which emitter it belongs to
+	uint32_t spawnCount = 0;
+	uint32_t emitCount = 0;
+	{
+		D3D11_MAPPED_SUBRESOURCE mapped = {};
+		HRESULT hr = context->Map(bufEmitterSpawns, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+		assert(hr == S_OK);
 
-			particleCS->CopyAllBufferData();
-			particleCS->DispatchByThreads(pool.particleConstants.maxParticles, 1, 1);
+		EmitterSpawn* spawns = reinterpret_cast<EmitterSpawn*>(mapped.pData);
+		for (auto iEmitter = pool.emitters.begin(); iEmitter != pool.emitters.end() && spawnCount < MAX_EMITTERS; ++iEmitter)
+		{
+			const Emitter& emitter = *iEmitter;
+			if (0 == emitter.emitCount)
+				continue;
+
+			EmitterSpawn& spawn = spawns[spawnCount++];
+			spawn.position = emitter.position;
+			spawn.velocity = emitter.velocity;
+			spawn.firstTicket = emitCount;
+			spawn.emitCount = emitter.emitCount;
+			spawn.emitterIndex = emitter.emitterIndex;
+			spawn.prewarmAge = emitter.prewarmAge;
+
+			emitCount += emitter.emitCount;
 		}
 
-		ID3D11UnorderedAccessView* nulls[] = { nullptr, nullptr, nullptr };
-		uint32_t initVals[] = { -1, -1, -1 };
-		context->CSSetUnorderedAccessViews(0, 3, nulls, initVals);
+		context->Unmap(bufEmitterSpawns, 0);
 	}
+
+	uint32_t groupCount = (pool.particleConstants.maxParticles + 1023) / 1024;
+
+	uint32_t zeros[4] = {};
+	context->ClearUnorderedAccessViewUint(bufDispatchCountersUAV, zeros);
+
+	particleFusedCS->SetShader();
+	particleFusedCS->SetFloat("deltaTime", deltaTime);
+	particleFusedCS->SetFloat("totalTime", totalTime);
+	particleFusedCS->SetInt("maxParticles", pool.particleConstants.maxParticles);
+	particleFusedCS->SetInt("groupCount", groupCount);
+	particleFusedCS->SetInt("spawnCount", spawnCount);
+	particleFusedCS->SetInt("totalEmitCount", emitCount);
+	particleFusedCS->SetInt("spawnModules", pool.spawnModules);
+	particleFusedCS->SetInt("updateModules", pool.updateModules);
+	SetCullConstants(particleFusedCS, pool);
+	particleFusedCS->SetUnorderedAccessView("particles", pool.bufParticlesUAV);
+	particleFusedCS->SetUnorderedAccessView("drawList", pool.bufDrawListUAV, 0);
+	particleFusedCS->SetUnorderedAccessView("stats", pool.bufStatsUAV);
+	particleFusedCS->SetUnorderedAccessView("counters", bufDispatchCountersUAV);
+	particleFusedCS->SetShaderResourceView("spawns", bufEmitterSpawnsSRV);
+	particleFusedCS->SetShaderResourceView("emitterParams", pool.bufEmitterParamsSRV);
+	BindModules(particleFusedCS, pool);
+
+	particleFusedCS->CopyAllBufferData();
+
+	BeginProfile(pool, ReorderProfileKind(pool));
+	particleFusedCS->DispatchByGroups(groupCount, 1, 1);
+	profiler.End();
+}
+
+static_assert(DRAW_VARIANT_COUNT == PARTICLE_DRAW_STRATEGY_COUNT, "the draw tuner times every strategy");
+
+// all copies go through the one draw, as more quads per particle
+static uint32_t DrawIndexCount(const ParticlePool& pool)
+{
+	return 6 * (pool.instanced ? pool.instanceCount : 1);
+}
+
+void ParticleSystem::SetCullConstants(SimpleComputeShader * cs, const ParticlePool & pool)
+{
+	// instanced pools are drawn somewhere else than they are simulated
+	bool cull = cullPixelScale > 0.0f && !pool.instanced;
+
+	cs->SetFloat4("cullPlane", cullPlane);
+	cs->SetFloat("cullPixelScale", cullPixelScale);
+	cs->SetFloat("cullMinPixels", cull ? screenMinPixels : 0.0f);
+}
+
+void ParticleSystem::BindQuadResources(ISimpleShader * shader, const ParticlePool & pool, ParticleDrawStrategy strategy)
+{
+	shader->SetShaderResourceView("particles", pool.bufParticlesSRV);
+	shader->SetShaderResourceView("drawList", pool.bufDrawListSRV);
+	shader->SetShaderResourceView("emitterParams", pool.bufEmitterParamsSRV);
+	shader->SetShaderResourceView("emitterTransforms", pool.bufEmitterTransformsSRV);
+	shader->SetShaderResourceView("instances", pool.bufInstancesSRV);
+	shader->SetInt("instanceCount", pool.instanced ? pool.instanceCount : 0);
+	shader->SetInt("allSlots", pool.stateless);
+	shader->SetInt("stateless", pool.stateless && !pool.external);
+	shader->SetFloat("totalTime", totalTime);
+	shader->SetInt("vertexIds", PARTICLE_DRAW_VERTEX_ID == strategy);
+}
+
+void ParticleSystem::ExpandParticles(ParticlePool & pool, uint32_t argsOffset)
+{
+	particleExpandCS->SetShader();
+	BindQuadResources(particleExpandCS, pool, PARTICLE_DRAW_EXPANDED);
+	particleExpandCS->SetInt("drawArgsOffset", argsOffset);
+	particleExpandCS->SetInt("slotCount", pool.particleConstants.maxParticles);
+	particleExpandCS->SetUnorderedAccessView("vertices", pool.bufExpandedUAV);
+	particleExpandCS->SetUnorderedAccessView("drawArgs", bufIndirectDrawArgsUAV);
+	particleExpandCS->CopyAllBufferData();
+
+	particleExpandCS->DispatchByThreads(pool.particleConstants.maxParticles, 1, 1);
+
+	// the vertex shader reads the vertices, the draw the args
+	ID3D11UnorderedAccessView* nulls[] = { nullptr, nullptr };
+	context->CSSetUnorderedAccessViews(0, 2, nulls, nullptr);
+
+	ID3D11ShaderResourceView* nullSRVs[] = { nullptr, nullptr, nullptr, nullptr, nullptr };
+	context->CSSetShaderResources(0, 5, nullSRVs);
 }
 
 bool ParticleSystem::Draw(const DirectX::XMFLOAT4X4& matView, const DirectX::XMFLOAT4X4& matProj)
@@ -194,30 +613,79 @@ bool ParticleSystem::Draw(const DirectX::XMFLOAT4X4& matView, const DirectX::XMF
 		particleVS->SetShader();
 		particlePS->SetShader();
 
-		particleVS->SetMatrix4x4("view", matView);
-		particleVS->SetMatrix4x4("projection", matProj);
+		// a world size s at view depth z covers s * pixelScale / z pixels
+		D3D11_VIEWPORT viewport = {};
+		UINT viewportCount = 1;
+		context->RSGetViewports(&viewportCount, &viewport);
+		float pixelScale = matProj._22 * viewport.Height * 0.5f;
+
+		ISimpleShader* quadShaders[] = { particleVS, particleExpandCS };
+		for (uint32_t i = 0; i < 2; ++i)
+		{
+			quadShaders[i]->SetMatrix4x4("view", matView);
+			quadShaders[i]->SetMatrix4x4("projection", matProj);
+			quadShaders[i]->SetFloat("pixelScale", pixelScale);
+			quadShaders[i]->SetFloat("minPixels", screenMinPixels);
+			quadShaders[i]->SetFloat("maxPixels", screenMaxPixels);
+		}
 		particleVS->CopyAllBufferData();
 
 		particlePS->SetSamplerState("samp", sampler);
 
+		// next frame's simulate passes cull against this camera; the view
+		// matrix is transposed, so its third row gives the view depth
+		cullPlane = DirectX::XMFLOAT4(matView._31, matView._32, matView._33, matView._34);
+		cullPixelScale = pixelScale;
+
+		drawTuner.BeginFrame();
+
 		for (auto iPool = pools.begin(); iPool != pools.end(); ++iPool)
 		{
 			ParticlePool& pool = *iPool;
+			uint32_t argsOffset = (uint32_t)(iPool - pools.begin()) * PARTICLE_DRAW_ARGS_STRIDE;
+
+			if (pool.instanced && 0 == pool.instanceCount)
+				continue;
 
-			particleVS->SetShaderResourceView("particles", pool.bufParticlesSRV);
-			particleVS->SetShaderResourceView("drawList", pool.bufDrawListSRV);
+			ParticleDrawStrategy strategy = pool.drawStrategy;
+			if (PARTICLE_DRAW_AUTO == strategy)
+				strategy = (ParticleDrawStrategy)drawTuner.Begin(TUNED_KERNEL_DRAW, pool.particleConstants.maxParticles);
 
 			particlePS->SetShaderResourceView("tex", pool.texSRV);
 
-			context->CopyStructureCount(bufIndirectDrawArgs, 4, pool.bufDrawListUAV);
-			context->CopyStructureCount(bufIndirectDrawArgs, 24, pool.bufDeadListUAV);
+			if (PARTICLE_DRAW_EXPANDED == strategy)
+			{
+				ExpandParticles(pool, argsOffset);
+
+				particleExpandedVS->SetShader();
+				particleExpandedVS->SetShaderResourceView("vertices", pool.bufExpandedSRV);
+			}
+			else
+			{
+				particleVS->SetShader();
+				BindQuadResources(particleVS, pool, strategy);
+				particleVS->CopyBufferData("PoolConstants");
+			}
 
-			context->DrawIndexedInstancedIndirect(bufIndirectDrawArgs, 0);
+			// args were written by WriteDrawArgs at the end of Update
+			if (PARTICLE_DRAW_INSTANCED == strategy && pool.stateless)
+				context->DrawIndexedInstanced(DrawIndexCount(pool), pool.particleConstants.maxParticles, 0, 0, 0);
+			else if (PARTICLE_DRAW_INSTANCED == strategy)
+				context->DrawIndexedInstancedIndirect(bufIndirectDrawArgs, argsOffset);
+			else if (pool.stateless)
+				context->Draw(DrawIndexCount(pool) * pool.particleConstants.maxParticles, 0);
+			else
+				context->DrawInstancedIndirect(bufIndirectDrawArgs, argsOffset + PARTICLE_DRAW_VERTEX_ARGS_OFFSET);
+
+			if (PARTICLE_DRAW_AUTO == pool.drawStrategy)
+				drawTuner.End();
 		}
 
+		drawTuner.EndFrame();
+
 		{
-			ID3D11ShaderResourceView* nulls[] = { nullptr, nullptr, nullptr };
-			context->VSSetShaderResources(0, 3, nulls);
+			ID3D11ShaderResourceView* nulls[] = { nullptr, nullptr, nullptr, nullptr, nullptr };
+			context->VSSetShaderResources(0, 5, nulls);
 		}
 	}
 
@@ -236,41 +704,265 @@ void ParticleSystem::CleanUp()
 
 	pools.clear();
 	poolMap.clear();
+	atlasTextures.clear();
 
 	delete particleVS;
+	delete particleExpandedVS;
 	delete particlePS;
 	delete particleInitCS;
-	delete particleEmitterCS;
-	delete particleCS;
+	for (uint32_t i = 0; i < KERNEL_VARIANT_COUNT; ++i)
+	{
+		delete particleEmitterCS[i];
+		for (uint32_t f = 0; f < PARTICLE_FEATURE_MASKS; ++f)
+			delete particleCS[f][i];
+	}
+	delete particleEmitterBitsetCS;
+	delete particleFusedCS;
+	delete particleSortKeysCS;
+	delete particleSortStepCS;
+	delete particleReorderCS;
+	delete particleRecycleHistogramCS;
+	delete particleRecycleCollectCS;
+	delete particleExpandCS;
+	delete particleDrawArgsCS;
+
+	while (!recordings.empty())
+		EndRecording((uint32_t)recordings.size() - 1);
+
+	for (auto iPlayback = playbacks.begin(); iPlayback != playbacks.end(); ++iPlayback)
+	{
+		delete iPlayback->player;
+		for (uint32_t i = 0; i < PARTICLE_PLAYBACK_UPLOAD_BUFFERS; ++i)
+			iPlayback->upload[i]->Release();
+	}
+	playbacks.clear();
 
 	bufQuadIndices->Release();
-	bufIndirectDrawArgs->Release();
+	if (nullptr != bufIndirectDrawArgs)
+	{
+		bufIndirectDrawArgs->Release();
+		bufIndirectDrawArgsUAV->Release();
+	}
+	bufIndirectDrawArgs = nullptr;
+	bufIndirectDrawArgsUAV = nullptr;
+	drawArgsCapacity = 0;
+	bufDispatchCounters->Release();
+	bufDispatchCountersUAV->Release();
+	bufRecycleCounters->Release();
+	bufRecycleCountersUAV->Release();
+	bufEmitterSpawns->Release();
+	bufEmitterSpawnsSRV->Release();
 	sampler->Release();
+
+	tuner.CleanUp();
+	drawTuner.CleanUp();
+	profiler.CleanUp();
 }
 
 ParticleEmitter* ParticleSystem::CreateParticleEmitter(const std::wstring & particleTexture)
 {
 	if (poolMap.find(particleTexture) == poolMap.end())
 	{
-		assert(true == CreateParticlePool(1024, particleTexture));
+		assert(true == CreateParticlePool(particleTexture, ParticlePoolDesc()));
 	}
 
 	uint32_t poolIdx = poolMap[particleTexture];
-	ParticlePool& pool = pools[poolIdx];
+	uint32_t emitterIdx = pools[poolIdx].emitters.size();
+
+	// particles find their emitter's EmitterParams by index
+	assert(emitterIdx < MAX_EMITTERS);
+
+	// every chunk runs its own copy of the emitter at a share of the rate
+	for (uint32_t i = 0; i < pools[poolIdx].chunkCount; ++i)
+	{
+		ParticlePool& pool = pools[poolIdx + i];
+		pool.emitters.push_back(Emitter());
+		pool.emitterParams.push_back(EmitterParams());
+		pool.emitterTransforms.push_back(DirectX::XMFLOAT4X4());
+		pool.emitOrderDirty = true;
+		pool.emitterParamsDirty = true;
+		pool.emitterTransformsDirty = true;
+	}
+
+	ParticleEmitter* emitter = new ParticleEmitter(this, poolIdx, emitterIdx);
 
-	uint32_t emitterIdx = pool.emitters.size();
-	pool.emitters.push_back(Emitter());
+	// named after one texture of an atlas pool: draw that one
+	auto iTexture = atlasTextures.find(particleTexture);
+	if (iTexture != atlasTextures.end())
+		emitter->SetTexture(iTexture->second);
 
-	return new ParticleEmitter(this, poolIdx, emitterIdx);
+	return emitter;
 }
 
-bool ParticleSystem::CreateParticlePool(uint32_t maxParticles, const std::wstring& texFileName)
+bool ParticleSystem::CreateParticlePool(const std::wstring& texFileName, const ParticlePoolDesc& desc)
 {
 	if (poolMap.find(texFileName) != poolMap.end())
 		return false;
 
-	ParticlePool pool;
-	pool.particleConstants.maxParticles = maxParticles;
+	ID3D11ShaderResourceView* texSRV = nullptr;
+	HRESULT hr = DirectX::CreateWICTextureFromFile(device, texFileName.c_str(), nullptr, &texSRV);
+	assert(hr == S_OK);
+
+	CreatePoolChunks(texFileName, texSRV, desc);
+	return true;
+}
+
+void ParticleSystem::CreatePoolChunks(const std::wstring & name, ID3D11ShaderResourceView * texSRV, const ParticlePoolDesc & desc)
+{
+	assert(desc.maxParticles > 0);
+
+	// a chunk's particle buffer has to fit the smallest resource size D3D11
+	// guarantees, and its 1D dispatches the per-dimension group limit at
+	// the largest group size; KernelTuner leaves out the ones that don't fit
+	const uint32_t maxChunkParticles = min(
+		(D3D11_REQ_RESOURCE_SIZE_IN_MEGABYTES_EXPRESSION_A_TERM << 20) / (uint32_t)sizeof(Particle),
+		D3D11_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION * 1024u);
+
+	uint32_t chunkParticles = desc.chunkParticles > 0 ? min(desc.chunkParticles, maxChunkParticles) : maxChunkParticles;
+	uint32_t chunkCount = (desc.maxParticles - 1) / chunkParticles + 1;
+
+	poolMap.insert(std::pair<std::wstring, uint32_t>{name, (uint32_t)pools.size()});
+
+	uint32_t remaining = desc.maxParticles;
+	for (uint32_t i = 0; i < chunkCount; ++i)
+	{
+		ParticlePool pool;
+		pool.particleConstants.maxParticles = min(remaining, chunkParticles);
+		pool.chunkIndex = i;
+		pool.chunkBase = desc.maxParticles - remaining;
+		pool.chunkCount = chunkCount;
+		pool.chunkShare = (float)pool.particleConstants.maxParticles / desc.maxParticles;
+
+		// every chunk holds a reference to the shared texture
+		if (i > 0)
+			texSRV->AddRef();
+		pool.texSRV = texSRV;
+
+		CreatePoolChunk(pool, desc);
+		pools.push_back(pool);
+
+		remaining -= pool.particleConstants.maxParticles;
+	}
+
+	ReserveDrawArgs();
+}
+
+void ParticleSystem::ReserveDrawArgs()
+{
+	if (pools.size() <= drawArgsCapacity)
+		return;
+
+	uint32_t capacity = max((uint32_t)pools.size(), 2 * drawArgsCapacity);
+
+	CD3D11_BUFFER_DESC argsDesc(
+		PARTICLE_DRAW_ARGS_STRIDE * capacity,
+		D3D11_BIND_UNORDERED_ACCESS,
+		D3D11_USAGE_DEFAULT,
+		0,
+		D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS | D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS
+	);
+
+	// index counts only change with SetInstances, the rest every frame
+	std::vector<uint32_t> args(capacity * PARTICLE_DRAW_ARGS_STRIDE / sizeof(uint32_t), 0);
+	for (uint32_t i = 0; i < pools.size(); ++i)
+		args[i * PARTICLE_DRAW_ARGS_STRIDE / sizeof(uint32_t)] = DrawIndexCount(pools[i]);
+
+	D3D11_SUBRESOURCE_DATA data = {};
+	data.pSysMem = args.data();
+
+	ID3D11Buffer* buffer = nullptr;
+	HRESULT hr = device->CreateBuffer(&argsDesc, &data, &buffer);
+	assert(hr == S_OK);
+
+	CD3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc(
+		buffer,
+		DXGI_FORMAT_R32_TYPELESS,
+		0, (uint32_t)args.size(),
+		D3D11_BUFFER_UAV_FLAG_RAW
+	);
+
+	ID3D11UnorderedAccessView* uav = nullptr;
+	hr = device->CreateUnorderedAccessView(buffer, &uavDesc, &uav);
+	assert(hr == S_OK);
+
+	// keep the counts already written for the existing pools
+	if (nullptr != bufIndirectDrawArgs)
+	{
+		D3D11_BOX box = { 0, 0, 0, drawArgsCapacity * PARTICLE_DRAW_ARGS_STRIDE, 1, 1 };
+		context->CopySubresourceRegion(buffer, 0, 0, 0, 0, bufIndirectDrawArgs, 0, &box);
+		bufIndirectDrawArgs->Release();
+		bufIndirectDrawArgsUAV->Release();
+	}
+
+	bufIndirectDrawArgs = buffer;
+	bufIndirectDrawArgsUAV = uav;
+	drawArgsCapacity = capacity;
+}
+
+void ParticleSystem::WriteDrawArgs()
+{
+	// every pool's counts in one pass, so no draw waits on the write of
+	// another's args
+	bool vertexArgs = false;
+	for (uint32_t i = 0; i < pools.size(); ++i)
+	{
+		ParticlePool& pool = pools[i];
+		if (pool.stateless)
+			continue;
+
+		uint32_t offset = i * PARTICLE_DRAW_ARGS_STRIDE;
+		context->CopyStructureCount(bufIndirectDrawArgs, offset + 4, pool.bufDrawListUAV);
+		if (nullptr != pool.bufDeadListUAV)
+			context->CopyStructureCount(bufIndirectDrawArgs, offset + 24, pool.bufDeadListUAV);
+
+		vertexArgs |= pool.drawStrategy != PARTICLE_DRAW_INSTANCED;
+	}
+
+	// and the non-indexed args derived from them, for all pools at once
+	if (vertexArgs)
+	{
+		particleDrawArgsCS->SetShader();
+		particleDrawArgsCS->SetInt("regionCount", (uint32_t)pools.size());
+		particleDrawArgsCS->SetInt("regionStride", PARTICLE_DRAW_ARGS_STRIDE);
+		particleDrawArgsCS->SetInt("vertexArgsOffset", PARTICLE_DRAW_VERTEX_ARGS_OFFSET);
+		particleDrawArgsCS->SetUnorderedAccessView("drawArgs", bufIndirectDrawArgsUAV);
+		particleDrawArgsCS->CopyAllBufferData();
+		particleDrawArgsCS->DispatchByThreads((uint32_t)pools.size(), 1, 1);
+	}
+}
+
+void ParticleSystem::CreatePoolChunk(ParticlePool & pool, const ParticlePoolDesc & desc)
+{
+	pool.particleConstants.ringStart = pool.particleConstants.maxParticles;
+	pool.overflowPolicy = desc.overflowPolicy;
+	pool.spawnsClamped = 0;
+	pool.stateless = desc.stateless;
+	pool.statelessHead = 0;
+	pool.external = false;
+	pool.ringAllocation = desc.stateless ? false : desc.ringAllocation;
+	pool.allocator = desc.stateless ? PARTICLE_ALLOCATOR_DEAD_LIST : desc.allocator;
+	pool.fusedUpdate = desc.stateless ? false : desc.fusedUpdate;
+	pool.features = pool.allocator == PARTICLE_ALLOCATOR_BITSET ? PARTICLE_FEATURE_BITSET : 0;
+
+	// resolved now: emitters are added later, maybe from another thread
+	uint32_t hostNode = desc.hostNode == HOST_NODE_ANY ? HostCurrentNode() : desc.hostNode;
+	pool.emitters = ParticlePool::EmitterArray(HostAllocator<Emitter>(hostNode));
+	pool.emitOrder = ParticlePool::IndexArray(HostAllocator<uint32_t>(hostNode));
+	pool.emitterRanks = ParticlePool::IndexArray(HostAllocator<uint32_t>(hostNode));
+	pool.emitterParams = ParticlePool::EmitterParamsArray(HostAllocator<EmitterParams>(hostNode));
+	pool.emitterParamsDirty = false;
+	pool.emitterTransforms = ParticlePool::TransformArray(HostAllocator<DirectX::XMFLOAT4X4>(hostNode));
+	pool.emitterTransformsDirty = false;
+	pool.reorderInterval = desc.allocator == PARTICLE_ALLOCATOR_BITSET || desc.stateless ? 0 : desc.reorderInterval;
+	pool.reorderStepsPerFrame = desc.reorderStepsPerFrame;
+	pool.reorderCellSize = desc.reorderCellSize;
+	pool.reorderFrames = 0;
+	pool.reorderCount = 0;
+	pool.reorderPaddedCount = 0;
+	pool.reorderBlockSize = 0;
+	pool.reorderStride = 0;
+	pool.reorderSinceSort = PROFILE_REORDER_FRAMES;
+	pool.timings = ParticlePoolTimings();
 
 	HRESULT hr = S_OK;
 
@@ -295,60 +987,1192 @@ bool ParticleSystem::CreateParticlePool(uint32_t maxParticles, const std::wstrin
 	bufDesc.ByteWidth = pool.particleConstants.maxParticles * sizeof(uint32_t);
 	bufDesc.StructureByteStride = sizeof(uint32_t);
 
-	hr = device->CreateBuffer(&bufDesc, nullptr, &pool.bufDeadList);
-	assert(hr == S_OK);
+	pool.bufDeadList = nullptr;
+	pool.bufDeadListUAV = nullptr;
+	if (pool.allocator == PARTICLE_ALLOCATOR_DEAD_LIST && !pool.fusedUpdate && !pool.stateless)
+	{
+		hr = device->CreateBuffer(&bufDesc, nullptr, &pool.bufDeadList);
+		assert(hr == S_OK);
+	}
 
 	bufDesc.BindFlags |= D3D11_BIND_SHADER_RESOURCE;
 
 	hr = device->CreateBuffer(&bufDesc, nullptr, &pool.bufDrawList);
 	assert(hr == S_OK);
 
-	CD3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc(
-		(ID3D11Buffer*)nullptr,
-		DXGI_FORMAT_UNKNOWN,
-		0, pool.particleConstants.maxParticles,
-		D3D11_BUFFER_UAV_FLAG_APPEND
-	);
+	// without a dead list every policy drops
+	pool.bufRecycleList = nullptr;
+	pool.bufRecycleListUAV = nullptr;
+	pool.bufRecycleListSRV = nullptr;
+	if (nullptr != pool.bufDeadList && (pool.overflowPolicy == OVERFLOW_RECYCLE || pool.overflowPolicy == OVERFLOW_STEAL))
+	{
+		hr = device->CreateBuffer(&bufDesc, nullptr, &pool.bufRecycleList);
+		assert(hr == S_OK);
+	}
 
-	hr = device->CreateUnorderedAccessView(pool.bufParticles, nullptr, &pool.bufParticlesUAV);
-	assert(hr == S_OK);
+	pool.bufOccupancy = nullptr;
+	pool.bufOccupancyUAV = nullptr;
+	pool.bufBlockFull = nullptr;
+	pool.bufBlockFullUAV = nullptr;
+	if (pool.allocator == PARTICLE_ALLOCATOR_BITSET && !pool.fusedUpdate)
+	{
+		uint32_t blocks = (pool.particleConstants.maxParticles + BITSET_BLOCK_SLOTS - 1) / BITSET_BLOCK_SLOTS;
 
-	hr = device->CreateShaderResourceView(pool.bufParticles, nullptr, &pool.bufParticlesSRV);
-	assert(hr == S_OK);
+		CreateCounterBuffer(blocks * BITSET_WORDS_PER_BLOCK, &pool.bufOccupancy, &pool.bufOccupancyUAV);
+		CreateCounterBuffer((blocks + BITSET_WORD_BITS - 1) / BITSET_WORD_BITS, &pool.bufBlockFull, &pool.bufBlockFullUAV);
+	}
 
-	hr = device->CreateUnorderedAccessView(pool.bufDeadList, nullptr, &pool.bufDeadListUAV);
-	assert(hr == S_OK);
+	pool.bufSortKeys = nullptr;
+	pool.bufSortKeysUAV = nullptr;
+	pool.bufSortKeysSRV = nullptr;
+	pool.bufReorderScratch = nullptr;
+	pool.bufReorderScratchUAV = nullptr;
+	CD3D11_BUFFER_DESC paramsDesc(
+		MAX_EMITTERS * sizeof(EmitterParams),
+		D3D11_BIND_SHADER_RESOURCE,
+		D3D11_USAGE_DEFAULT,
+		0,
+		D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
+		sizeof(EmitterParams)
+	);
 
-	hr = device->CreateUnorderedAccessView(pool.bufDrawList, &uavDesc, &pool.bufDrawListUAV);
+	hr = device->CreateBuffer(&paramsDesc, nullptr, &pool.bufEmitterParams);
 	assert(hr == S_OK);
 
-	hr = device->CreateShaderResourceView(pool.bufDrawList, nullptr, &pool.bufDrawListSRV);
+	hr = device->CreateShaderResourceView(pool.bufEmitterParams, nullptr, &pool.bufEmitterParamsSRV);
 	assert(hr == S_OK);
 
-	particleInitCS->SetUnorderedAccessView("particles", pool.bufParticlesUAV);
-	particleInitCS->SetUnorderedAccessView("deadList", pool.bufDeadListUAV);
-	particleInitCS->SetShader();
-	context->Dispatch((pool.particleConstants.maxParticles + 1023) / 1024, 1, 1);
+	pool.bufEmitterRanks = nullptr;
+	pool.bufEmitterRanksSRV = nullptr;
+	if (nullptr != pool.bufRecycleList && pool.overflowPolicy == OVERFLOW_STEAL)
 	{
-		ID3D11UnorderedAccessView* nullUAV = nullptr;
-		uint32_t val = D3D11_KEEP_UNORDERED_ACCESS_VIEWS;
-		context->CSSetUnorderedAccessViews(0, 1, &nullUAV, &val);
+		CD3D11_BUFFER_DESC ranksDesc(
+			MAX_EMITTERS * sizeof(uint32_t),
+			D3D11_BIND_SHADER_RESOURCE,
+			D3D11_USAGE_DEFAULT,
+			0,
+			D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
+			sizeof(uint32_t)
+		);
+
+		hr = device->CreateBuffer(&ranksDesc, nullptr, &pool.bufEmitterRanks);
+		assert(hr == S_OK);
+
+		hr = device->CreateShaderResourceView(pool.bufEmitterRanks, nullptr, &pool.bufEmitterRanksSRV);
+		assert(hr == S_OK);
 	}
-	context->CSSetShader(nullptr, nullptr, 0);
 
-	pool.bufDeadListUAV->Release();
+	pool.instanced = desc.instanced;
+	pool.instanceCount = 0;
+	pool.bufInstances = nullptr;
+	pool.bufInstancesSRV = nullptr;
+	if (pool.instanced)
+	{
+		CD3D11_BUFFER_DESC instancesDesc(
+			MAX_PARTICLE_INSTANCES * sizeof(ParticleInstance),
+			D3D11_BIND_SHADER_RESOURCE,
+			D3D11_USAGE_DYNAMIC,
+			D3D11_CPU_ACCESS_WRITE,
+			D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
+			sizeof(ParticleInstance)
+		);
 
-	hr = device->CreateUnorderedAccessView(pool.bufDeadList, &uavDesc, &pool.bufDeadListUAV);
-	assert(hr == S_OK);
+		hr = device->CreateBuffer(&instancesDesc, nullptr, &pool.bufInstances);
+		assert(hr == S_OK);
 
-	hr = DirectX::CreateWICTextureFromFile(device, texFileName.c_str(), nullptr, &pool.texSRV);
-	assert(hr == S_OK);
+		hr = device->CreateShaderResourceView(pool.bufInstances, nullptr, &pool.bufInstancesSRV);
+		assert(hr == S_OK);
+	}
 
-	pool.particleFirstUpdate = true;
+	// expanding needs six vertices per particle in one buffer, and copies
+	// would multiply that
+	const uint64_t expandedSize = 6ull * pool.particleConstants.maxParticles * sizeof(ParticleVertex);
+	bool expandable = !pool.instanced && expandedSize <= (D3D11_REQ_RESOURCE_SIZE_IN_MEGABYTES_EXPRESSION_A_TERM << 20);
+
+	pool.drawStrategy = desc.drawStrategy;
+	if (!expandable && PARTICLE_DRAW_EXPANDED == pool.drawStrategy)
+		pool.drawStrategy = PARTICLE_DRAW_VERTEX_ID;
+	else if (!expandable && PARTICLE_DRAW_AUTO == pool.drawStrategy)
+		pool.drawStrategy = PARTICLE_DRAW_INSTANCED;
+
+	pool.bufExpanded = nullptr;
+	pool.bufExpandedUAV = nullptr;
+	pool.bufExpandedSRV = nullptr;
+	if (PARTICLE_DRAW_EXPANDED == pool.drawStrategy || PARTICLE_DRAW_AUTO == pool.drawStrategy)
+	{
+		CD3D11_BUFFER_DESC expandedDesc(
+			(uint32_t)expandedSize,
+			D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE,
+			D3D11_USAGE_DEFAULT,
+			0,
+			D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
+			sizeof(ParticleVertex)
+		);
 
-	uint32_t idx = pools.size();
-	pools.push_back(pool);
-	poolMap.insert(std::pair<std::wstring, uint32_t>{texFileName, idx});
+		hr = device->CreateBuffer(&expandedDesc, nullptr, &pool.bufExpanded);
+		assert(hr == S_OK);
 
-	return true;
+		hr = device->CreateUnorderedAccessView(pool.bufExpanded, nullptr, &pool.bufExpandedUAV);
+		assert(hr == S_OK);
+
+		hr = device->CreateShaderResourceView(pool.bufExpanded, nullptr, &pool.bufExpandedSRV);
+		assert(hr == S_OK);
+	}
+
+	// moving emitters rewrite their transforms every frame
+	CD3D11_BUFFER_DESC transformsDesc(
+		MAX_EMITTERS * sizeof(DirectX::XMFLOAT4X4),
+		D3D11_BIND_SHADER_RESOURCE,
+		D3D11_USAGE_DYNAMIC,
+		D3D11_CPU_ACCESS_WRITE,
+		D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
+		sizeof(DirectX::XMFLOAT4X4)
+	);
+
+	hr = device->CreateBuffer(&transformsDesc, nullptr, &pool.bufEmitterTransforms);
+	assert(hr == S_OK);
+
+	hr = device->CreateShaderResourceView(pool.bufEmitterTransforms, nullptr, &pool.bufEmitterTransformsSRV);
+	assert(hr == S_OK);
+
+	pool.bufModuleCode = nullptr;
+	pool.bufModuleCodeSRV = nullptr;
+	pool.bufModuleConstants = nullptr;
+	pool.bufModuleConstantsSRV = nullptr;
+	pool.spawnModules = 0;
+	pool.updateModules = 0;
+
+	// the fused pass has no event output, stateless pools no pass at all
+	pool.eventCapacity = pool.fusedUpdate || pool.stateless ? 0 : desc.eventCapacity;
+	pool.eventMask = desc.eventMask;
+	pool.eventHead = 0;
+	pool.eventsInFlight = 0;
+	pool.bufEvents = nullptr;
+	pool.bufEventsUAV = nullptr;
+	pool.bufEventCount = nullptr;
+	pool.bufEventCountUAV = nullptr;
+	for (uint32_t i = 0; i < PARTICLE_EVENT_READBACK_FRAMES; ++i)
+	{
+		pool.bufEventStaging[i] = nullptr;
+		pool.bufEventCountStaging[i] = nullptr;
+	}
+	if (pool.eventCapacity > 0)
+	{
+		pool.features |= PARTICLE_FEATURE_EVENTS;
+
+		CD3D11_BUFFER_DESC eventsDesc(
+			pool.eventCapacity * sizeof(ParticleEvent),
+			D3D11_BIND_UNORDERED_ACCESS,
+			D3D11_USAGE_DEFAULT,
+			0,
+			D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
+			sizeof(ParticleEvent)
+		);
+
+		hr = device->CreateBuffer(&eventsDesc, nullptr, &pool.bufEvents);
+		assert(hr == S_OK);
+
+		hr = device->CreateUnorderedAccessView(pool.bufEvents, nullptr, &pool.bufEventsUAV);
+		assert(hr == S_OK);
+
+		CreateCounterBuffer(1, &pool.bufEventCount, &pool.bufEventCountUAV);
+
+		CD3D11_BUFFER_DESC stagingDesc(eventsDesc.ByteWidth, 0, D3D11_USAGE_STAGING, D3D11_CPU_ACCESS_READ);
+		CD3D11_BUFFER_DESC countStagingDesc(sizeof(uint32_t), 0, D3D11_USAGE_STAGING, D3D11_CPU_ACCESS_READ);
+		for (uint32_t i = 0; i < PARTICLE_EVENT_READBACK_FRAMES; ++i)
+		{
+			hr = device->CreateBuffer(&stagingDesc, nullptr, &pool.bufEventStaging[i]);
+			assert(hr == S_OK);
+
+			hr = device->CreateBuffer(&countStagingDesc, nullptr, &pool.bufEventCountStaging[i]);
+			assert(hr == S_OK);
+		}
+	}
+	if (pool.reorderInterval > 0)
+	{
+		uint32_t paddedCount = 1;
+		while (paddedCount < pool.particleConstants.maxParticles)
+			paddedCount <<= 1;
+
+		CD3D11_BUFFER_DESC keysDesc(
+			paddedCount * sizeof(uint32_t) * 2,
+			D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE,
+			D3D11_USAGE_DEFAULT,
+			0,
+			D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
+			sizeof(uint32_t) * 2
+		);
+
+		hr = device->CreateBuffer(&keysDesc, nullptr, &pool.bufSortKeys);
+		assert(hr == S_OK);
+
+		hr = device->CreateUnorderedAccessView(pool.bufSortKeys, nullptr, &pool.bufSortKeysUAV);
+		assert(hr == S_OK);
+
+		hr = device->CreateShaderResourceView(pool.bufSortKeys, nullptr, &pool.bufSortKeysSRV);
+		assert(hr == S_OK);
+
+		CD3D11_BUFFER_DESC scratchDesc(
+			pool.particleConstants.maxParticles * sizeof(Particle),
+			D3D11_BIND_UNORDERED_ACCESS,
+			D3D11_USAGE_DEFAULT,
+			0,
+			D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
+			sizeof(Particle)
+		);
+
+		hr = device->CreateBuffer(&scratchDesc, nullptr, &pool.bufReorderScratch);
+		assert(hr == S_OK);
+
+		hr = device->CreateUnorderedAccessView(pool.bufReorderScratch, nullptr, &pool.bufReorderScratchUAV);
+		assert(hr == S_OK);
+	}
+
+	{
+		CreateCounterBuffer(PARTICLE_STAT_COUNT, &pool.bufStats, &pool.bufStatsUAV);
+
+		CD3D11_BUFFER_DESC stagingDesc(
+			PARTICLE_STAT_COUNT * sizeof(uint32_t),
+			0,
+			D3D11_USAGE_STAGING,
+			D3D11_CPU_ACCESS_READ
+		);
+
+		hr = device->CreateBuffer(&stagingDesc, nullptr, &pool.bufStatsStaging);
+		assert(hr == S_OK);
+
+		pool.stats = ParticlePoolStats();
+		pool.statsPending = false;
+	}
+
+	CD3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc(
+		(ID3D11Buffer*)nullptr,
+		DXGI_FORMAT_UNKNOWN,
+		0, pool.particleConstants.maxParticles,
+		D3D11_BUFFER_UAV_FLAG_APPEND
+	);
+
+	hr = device->CreateUnorderedAccessView(pool.bufParticles, nullptr, &pool.bufParticlesUAV);
+	assert(hr == S_OK);
+
+	hr = device->CreateShaderResourceView(pool.bufParticles, nullptr, &pool.bufParticlesSRV);
+	assert(hr == S_OK);
+
+	if (nullptr != pool.bufDeadList)
+	{
+		hr = device->CreateUnorderedAccessView(pool.bufDeadList, nullptr, &pool.bufDeadListUAV);
+		assert(hr == S_OK);
+	}
+
+	hr = device->CreateUnorderedAccessView(pool.bufDrawList, &uavDesc, &pool.bufDrawListUAV);
+	assert(hr == S_OK);
+
+	hr = device->CreateShaderResourceView(pool.bufDrawList, nullptr, &pool.bufDrawListSRV);
+	assert(hr == S_OK);
+
+	if (nullptr != pool.bufRecycleList)
+	{
+		// written by index, the counters count the victims
+		hr = device->CreateUnorderedAccessView(pool.bufRecycleList, nullptr, &pool.bufRecycleListUAV);
+		assert(hr == S_OK);
+
+		hr = device->CreateShaderResourceView(pool.bufRecycleList, nullptr, &pool.bufRecycleListSRV);
+		assert(hr == S_OK);
+	}
+
+	particleInitCS->SetUnorderedAccessView("particles", pool.bufParticlesUAV);
+	particleInitCS->SetUnorderedAccessView("deadList", pool.bufDeadListUAV);
+	particleInitCS->SetShader();
+	context->Dispatch((pool.particleConstants.maxParticles + 1023) / 1024, 1, 1);
+	{
+		ID3D11UnorderedAccessView* nullUAV = nullptr;
+		uint32_t val = D3D11_KEEP_UNORDERED_ACCESS_VIEWS;
+		context->CSSetUnorderedAccessViews(0, 1, &nullUAV, &val);
+	}
+	context->CSSetShader(nullptr, nullptr, 0);
+
+	if (nullptr != pool.bufDeadList)
+	{
+		pool.bufDeadListUAV->Release();
+
+		hr = device->CreateUnorderedAccessView(pool.bufDeadList, &uavDesc, &pool.bufDeadListUAV);
+		assert(hr == S_OK);
+	}
+
+	pool.particleFirstUpdate = true;
+	pool.emitOrderDirty = true;
+}
+
+void ParticleSystem::SetScreenSizeLimits(float minPixels, float maxPixels)
+{
+	screenMinPixels = minPixels;
+	screenMaxPixels = maxPixels;
+}
+
+ParticleDrawStrategy ParticleSystem::GetFastestDrawStrategy(uint32_t maxParticles) const
+{
+	int winner = drawTuner.GetWinner(TUNED_KERNEL_DRAW, maxParticles);
+	return winner < 0 ? PARTICLE_DRAW_AUTO : (ParticleDrawStrategy)winner;
+}
+
+bool ParticleSystem::GetStats(const std::wstring & particleTexture, ParticlePoolStats & stats) const
+{
+	auto iter = poolMap.find(particleTexture);
+	if (iter == poolMap.end())
+		return false;
+
+	stats = ParticlePoolStats();
+	for (uint32_t i = 0; i < pools[iter->second].chunkCount; ++i)
+	{
+		const ParticlePool& pool = pools[iter->second + i];
+		stats.dropped += pool.stats.dropped + pool.spawnsClamped;
+		stats.recycled += pool.stats.recycled;
+		stats.stolen += pool.stats.stolen;
+		stats.eventsDropped += pool.stats.eventsDropped;
+		stats.eventFramesSkipped += pool.stats.eventFramesSkipped;
+	}
+	return true;
+}
+
+void ParticleSystem::SetProfiling(bool enabled)
+{
+	profiling = enabled;
+}
+
+bool ParticleSystem::GetTimings(const std::wstring & particleTexture, ParticlePoolTimings & timings) const
+{
+	auto iter = poolMap.find(particleTexture);
+	if (iter == poolMap.end())
+		return false;
+
+	timings = ParticlePoolTimings();
+	for (uint32_t i = 0; i < pools[iter->second].chunkCount; ++i)
+	{
+		const ParticlePool& pool = pools[iter->second + i];
+		timings.simulate += pool.timings.simulate;
+		timings.beforeReorder += pool.timings.beforeReorder;
+		timings.afterReorder += pool.timings.afterReorder;
+		timings.allFeatures += pool.timings.allFeatures;
+	}
+	return true;
+}
+
+void ParticleSystem::BeginProfile(const ParticlePool & pool, ProfileKind kind)
+{
+	if (profiling)
+		profiler.Begin((uint32_t)(&pool - pools.data()) * PROFILE_KIND_COUNT + kind);
+}
+
+// Sorting only pays off if simulating gets faster, so the frames on either
+// side of a sort are timed apart from the rest
+ParticleSystem::ProfileKind ParticleSystem::ReorderProfileKind(const ParticlePool & pool) const
+{
+	if (0 == pool.reorderInterval || pool.reorderStride > 0)
+		return PROFILE_SIMULATE;
+
+	if (pool.reorderSinceSort < PROFILE_REORDER_FRAMES)
+		return PROFILE_AFTER_REORDER;
+	if (pool.reorderFrames + PROFILE_REORDER_FRAMES >= pool.reorderInterval)
+		return PROFILE_BEFORE_REORDER;
+	return PROFILE_SIMULATE;
+}
+
+// moving average over roughly the last eight samples
+static void Smooth(float & average, double seconds)
+{
+	float ms = (float)(seconds * 1000.0);
+	average = 0.0f == average ? ms : average + (ms - average) * 0.125f;
+}
+
+void ParticleSystem::ApplyTimings()
+{
+	for (auto iTiming = landedTimings.begin(); iTiming != landedTimings.end(); ++iTiming)
+	{
+		// pools only ever get added, but profiling may have been off and
+		// on again since the timing was taken
+		uint32_t poolIdx = iTiming->tag / PROFILE_KIND_COUNT;
+		if (poolIdx >= pools.size())
+			continue;
+
+		ParticlePoolTimings& timings = pools[poolIdx].timings;
+		if (PROFILE_ALL_FEATURES == iTiming->tag % PROFILE_KIND_COUNT)
+		{
+			Smooth(timings.allFeatures, iTiming->seconds);
+			continue;
+		}
+
+		switch (iTiming->tag % PROFILE_KIND_COUNT)
+		{
+		case PROFILE_BEFORE_REORDER:
+			Smooth(timings.beforeReorder, iTiming->seconds);
+			break;
+		case PROFILE_AFTER_REORDER:
+			Smooth(timings.afterReorder, iTiming->seconds);
+			break;
+		}
+		Smooth(timings.simulate, iTiming->seconds);
+	}
+	landedTimings.clear();
+}
+
+void ParticleSystem::ReadBackStats(ParticlePool & pool)
+{
+	// never wait on the GPU here: if last frame's copy hasn't landed yet,
+	// keep the old numbers and try again next frame
+	if (pool.statsPending)
+	{
+		D3D11_MAPPED_SUBRESOURCE mapped = {};
+		if (S_OK == context->Map(pool.bufStatsStaging, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped))
+		{
+			const uint32_t* counters = reinterpret_cast<const uint32_t*>(mapped.pData);
+			pool.stats.dropped = counters[PARTICLE_STAT_DROPPED];
+			pool.stats.recycled = counters[PARTICLE_STAT_RECYCLED];
+			pool.stats.stolen = counters[PARTICLE_STAT_STOLEN];
+			context->Unmap(pool.bufStatsStaging, 0);
+			pool.statsPending = false;
+		}
+	}
+
+	if (!pool.statsPending)
+	{
+		context->CopyResource(pool.bufStatsStaging, pool.bufStats);
+		pool.statsPending = true;
+	}
+}
+
+void ParticleSystem::ReserveRings(ParticlePool & pool)
+{
+	if (!pool.ringAllocation)
+		return;
+
+	// rings are carved from the top of the pool so the dead list keeps a
+	// contiguous [0, ringStart) range. The capacity is fixed from here on:
+	// raising emitRate or lifeTime later makes the ring overwrite its
+	// oldest particles early instead of growing
+	uint32_t ringStart = pool.particleConstants.maxParticles;
+	for (auto iEmitter = pool.emitters.begin(); iEmitter != pool.emitters.end(); ++iEmitter)
+	{
+		Emitter& emitter = *iEmitter;
+
+		// an eighth of headroom absorbs frame-to-frame jitter in emitCount
+		float alive = emitter.emitRate * pool.emitterParams[emitter.emitterIndex].lifeTime;
+		uint32_t capacity = static_cast<uint32_t>(ceil(alive * 1.125f)) + 1;
+
+		if (alive <= 0.0f || capacity > ringStart)
+			continue;
+
+		ringStart -= capacity;
+		emitter.ringBase = ringStart;
+		emitter.ringSize = capacity;
+		emitter.ringHead = 0;
+	}
+
+	pool.particleConstants.ringStart = ringStart;
+}
+
+void ParticleSystem::CreateCounterBuffer(uint32_t count, ID3D11Buffer ** buffer, ID3D11UnorderedAccessView ** uav)
+{
+	CD3D11_BUFFER_DESC desc(
+		count * sizeof(uint32_t),
+		D3D11_BIND_UNORDERED_ACCESS,
+		D3D11_USAGE_DEFAULT,
+		0,
+		D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
+		sizeof(uint32_t)
+	);
+
+	HRESULT hr = device->CreateBuffer(&desc, nullptr, buffer);
+	assert(hr == S_OK);
+
+	hr = device->CreateUnorderedAccessView(*buffer, nullptr, uav);
+	assert(hr == S_OK);
+
+	uint32_t zeros[4] = {};
+	context->ClearUnorderedAccessViewUint(*uav, zeros);
+}
+
+void ParticleSystem::PickRecycleVictims(ParticlePool & pool, uint32_t victimCount)
+{
+	if (nullptr == pool.bufRecycleList)
+		return;
+
+	// also resets the victim and claim counts the emitter pass reads
+	uint32_t zeros[4] = {};
+	context->ClearUnorderedAccessViewUint(bufRecycleCountersUAV, zeros);
+
+	uint32_t count = pool.particleConstants.ringStart;
+	if (0 == victimCount || 0 == count)
+		return;
+
+	// picked before any of this frame's spawns, so that no spawn can land
+	// on a slot another one just took from the dead list
+	particleRecycleHistogramCS->SetShader();
+	particleRecycleHistogramCS->SetInt("count", count);
+	particleRecycleHistogramCS->SetInt("victimCount", victimCount);
+	particleRecycleHistogramCS->SetInt("groupCount", (count + 1023) / 1024);
+	particleRecycleHistogramCS->SetInt("overflowPolicy", pool.overflowPolicy);
+	particleRecycleHistogramCS->SetShaderResourceView("particles", pool.bufParticlesSRV);
+	particleRecycleHistogramCS->SetShaderResourceView("emitterParams", pool.bufEmitterParamsSRV);
+	particleRecycleHistogramCS->SetShaderResourceView("emitterRanks", pool.bufEmitterRanksSRV);
+	particleRecycleHistogramCS->SetUnorderedAccessView("counters", bufRecycleCountersUAV);
+	particleRecycleHistogramCS->CopyAllBufferData();
+	particleRecycleHistogramCS->DispatchByGroups((count + 1023) / 1024, 1, 1);
+
+	particleRecycleCollectCS->SetShader();
+	particleRecycleCollectCS->SetInt("count", count);
+	particleRecycleCollectCS->SetInt("victimCount", victimCount);
+	particleRecycleCollectCS->SetInt("overflowPolicy", pool.overflowPolicy);
+	particleRecycleCollectCS->SetShaderResourceView("particles", pool.bufParticlesSRV);
+	particleRecycleCollectCS->SetShaderResourceView("emitterParams", pool.bufEmitterParamsSRV);
+	particleRecycleCollectCS->SetShaderResourceView("emitterRanks", pool.bufEmitterRanksSRV);
+	particleRecycleCollectCS->SetUnorderedAccessView("counters", bufRecycleCountersUAV);
+	particleRecycleCollectCS->SetUnorderedAccessView("victims", pool.bufRecycleListUAV);
+	particleRecycleCollectCS->CopyAllBufferData();
+	particleRecycleCollectCS->DispatchByThreads(count, 1, 1);
+
+	// the emitter pass reads the victims and writes the particles
+	ID3D11UnorderedAccessView* nulls[] = { nullptr, nullptr };
+	context->CSSetUnorderedAccessViews(0, 2, nulls, nullptr);
+
+	ID3D11ShaderResourceView* nullSRVs[] = { nullptr, nullptr, nullptr, nullptr, nullptr };
+	context->CSSetShaderResources(0, 5, nullSRVs);
+}
+
+void ParticleSystem::ReorderParticles(ParticlePool & pool)
+{
+	if (0 == pool.reorderInterval)
+		return;
+
+	// the dead list only means something once the first update has filled it
+	if (!pool.fusedUpdate && pool.particleFirstUpdate)
+		return;
+
+	if (pool.reorderSinceSort < PROFILE_REORDER_FRAMES)
+		++pool.reorderSinceSort;
+
+	if (0 == pool.reorderStride)
+	{
+		if (++pool.reorderFrames < pool.reorderInterval)
+			return;
+		pool.reorderFrames = 0;
+
+		// ring slots belong to their emitter and must stay put
+		pool.reorderCount = pool.particleConstants.ringStart;
+		if (pool.reorderCount < 2)
+			return;
+
+		pool.reorderPaddedCount = 1;
+		while (pool.reorderPaddedCount < pool.reorderCount)
+			pool.reorderPaddedCount <<= 1;
+
+		particleSortKeysCS->SetShader();
+		particleSortKeysCS->SetInt("count", pool.reorderCount);
+		particleSortKeysCS->SetInt("paddedCount", pool.reorderPaddedCount);
+		particleSortKeysCS->SetFloat("cellSize", pool.reorderCellSize);
+		particleSortKeysCS->SetShaderResourceView("particles", pool.bufParticlesSRV);
+		particleSortKeysCS->SetUnorderedAccessView("keys", pool.bufSortKeysUAV);
+		particleSortKeysCS->CopyAllBufferData();
+		particleSortKeysCS->DispatchByThreads(pool.reorderPaddedCount, 1, 1);
+
+		pool.reorderBlockSize = 2;
+		pool.reorderStride = 1;
+	}
+
+	// particles keep moving while a time-sliced sort is in flight; the keys
+	// just go a little stale, the permutation they end up in is still valid
+	uint32_t steps = pool.reorderStepsPerFrame > 0 ? pool.reorderStepsPerFrame : UINT32_MAX;
+
+	particleSortStepCS->SetShader();
+	particleSortStepCS->SetInt("paddedCount", pool.reorderPaddedCount);
+	particleSortStepCS->SetUnorderedAccessView("keys", pool.bufSortKeysUAV);
+	for (; steps > 0 && pool.reorderStride > 0; --steps)
+	{
+		particleSortStepCS->SetInt("blockSize", pool.reorderBlockSize);
+		particleSortStepCS->SetInt("stride", pool.reorderStride);
+		particleSortStepCS->CopyAllBufferData();
+		particleSortStepCS->DispatchByThreads(pool.reorderPaddedCount, 1, 1);
+
+		if (pool.reorderStride > 1)
+		{
+			pool.reorderStride >>= 1;
+		}
+		else
+		{
+			pool.reorderBlockSize <<= 1;
+			pool.reorderStride = pool.reorderBlockSize <= pool.reorderPaddedCount ? pool.reorderBlockSize >> 1 : 0;
+		}
+	}
+
+	{
+		ID3D11UnorderedAccessView* nulls[] = { nullptr, nullptr };
+		uint32_t initVals[] = { -1, -1 };
+		context->CSSetUnorderedAccessViews(0, 2, nulls, initVals);
+		ID3D11ShaderResourceView* nullSRVs[] = { nullptr, nullptr };
+		context->CSSetShaderResources(0, 2, nullSRVs);
+	}
+
+	if (pool.reorderStride > 0)
+		return;
+
+	// gather into scratch, refilling the dead list from empty as we go. The
+	// draw list is rebuilt by this frame's simulate pass anyway
+	particleReorderCS->SetShader();
+	particleReorderCS->SetInt("count", pool.reorderCount);
+	particleReorderCS->SetShaderResourceView("particles", pool.bufParticlesSRV);
+	particleReorderCS->SetShaderResourceView("keys", pool.bufSortKeysSRV);
+	particleReorderCS->SetUnorderedAccessView("sorted", pool.bufReorderScratchUAV);
+	particleReorderCS->SetUnorderedAccessView("deadList", pool.bufDeadListUAV, 0);
+	particleReorderCS->CopyAllBufferData();
+	particleReorderCS->DispatchByThreads(pool.reorderCount, 1, 1);
+
+	{
+		ID3D11UnorderedAccessView* nulls[] = { nullptr, nullptr };
+		uint32_t initVals[] = { -1, -1 };
+		context->CSSetUnorderedAccessViews(0, 2, nulls, initVals);
+		ID3D11ShaderResourceView* nullSRVs[] = { nullptr, nullptr };
+		context->CSSetShaderResources(0, 2, nullSRVs);
+	}
+
+	D3D11_BOX box = {};
+	box.right = pool.reorderCount * sizeof(Particle);
+	box.bottom = 1;
+	box.back = 1;
+	context->CopySubresourceRegion(pool.bufParticles, 0, 0, 0, 0, pool.bufReorderScratch, 0, &box);
+
+	pool.reorderSinceSort = 0;
+}
+
+bool ParticleSystem::SetModules(const std::wstring & particleTexture, const ParticleModuleGraph & graph)
+{
+	auto iter = poolMap.find(particleTexture);
+	if (iter == poolMap.end())
+		return false;
+
+	ParticleProgram program;
+	if (!graph.Compile(program))
+		return false;
+
+	// the buffers are always allocated at the maximum program size, so
+	// replacing a program never has to recreate them
+	program.code.resize(MODULE_MAX_CODE);
+	program.constants.resize(MODULE_MAX_CONSTANTS);
+
+	for (uint32_t i = 0; i < pools[iter->second].chunkCount; ++i)
+	{
+		ParticlePool& pool = pools[iter->second + i];
+		HRESULT hr = S_OK;
+
+		if (nullptr == pool.bufModuleCode)
+		{
+			CD3D11_BUFFER_DESC codeDesc(
+				MODULE_MAX_CODE * sizeof(DirectX::XMUINT4),
+				D3D11_BIND_SHADER_RESOURCE,
+				D3D11_USAGE_DEFAULT,
+				0,
+				D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
+				sizeof(DirectX::XMUINT4)
+			);
+
+			hr = device->CreateBuffer(&codeDesc, nullptr, &pool.bufModuleCode);
+			assert(hr == S_OK);
+
+			hr = device->CreateShaderResourceView(pool.bufModuleCode, nullptr, &pool.bufModuleCodeSRV);
+			assert(hr == S_OK);
+
+			CD3D11_BUFFER_DESC constantsDesc(
+				MODULE_MAX_CONSTANTS * sizeof(DirectX::XMFLOAT4),
+				D3D11_BIND_SHADER_RESOURCE,
+				D3D11_USAGE_DEFAULT,
+				0,
+				D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
+				sizeof(DirectX::XMFLOAT4)
+			);
+
+			hr = device->CreateBuffer(&constantsDesc, nullptr, &pool.bufModuleConstants);
+			assert(hr == S_OK);
+
+			hr = device->CreateShaderResourceView(pool.bufModuleConstants, nullptr, &pool.bufModuleConstantsSRV);
+			assert(hr == S_OK);
+		}
+
+		context->UpdateSubresource(pool.bufModuleCode, 0, nullptr, program.code.data(), 0, 0);
+		context->UpdateSubresource(pool.bufModuleConstants, 0, nullptr, program.constants.data(), 0, 0);
+
+		pool.spawnModules = program.length[PARTICLE_STAGE_SPAWN];
+		pool.updateModules = program.length[PARTICLE_STAGE_UPDATE];
+
+		if (pool.updateModules > 0)
+			pool.features |= PARTICLE_FEATURE_MODULES;
+		else
+			pool.features &= ~PARTICLE_FEATURE_MODULES;
+	}
+
+	return true;
+}
+
+void ParticleSystem::UploadEmitterParams(ParticlePool & pool)
+{
+	if (pool.emitterParamsDirty)
+	{
+		// only the entries in use, the rest of the buffer is never indexed
+		D3D11_BOX box = { 0, 0, 0, (UINT)(pool.emitterParams.size() * sizeof(EmitterParams)), 1, 1 };
+		context->UpdateSubresource(pool.bufEmitterParams, 0, &box, pool.emitterParams.data(), 0, 0);
+
+		pool.emitterParamsDirty = false;
+	}
+
+	// moving a local-space emitter costs this copy, its particles stay put
+	if (pool.emitterTransformsDirty)
+	{
+		D3D11_MAPPED_SUBRESOURCE mapped = {};
+		HRESULT hr = context->Map(pool.bufEmitterTransforms, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+		assert(hr == S_OK);
+
+		memcpy(mapped.pData, pool.emitterTransforms.data(), pool.emitterTransforms.size() * sizeof(DirectX::XMFLOAT4X4));
+		context->Unmap(pool.bufEmitterTransforms, 0);
+
+		pool.emitterTransformsDirty = false;
+	}
+}
+
+void ParticleSystem::BindModules(SimpleComputeShader * cs, const ParticlePool & pool)
+{
+	cs->SetShaderResourceView("moduleCode", pool.bufModuleCodeSRV);
+	cs->SetShaderResourceView("moduleConstants", pool.bufModuleConstantsSRV);
+}
+
+bool ParticleSystem::SetShard(uint32_t index, uint32_t count)
+{
+	if (index >= count)
+		return false;
+
+	// the same rate and phase ParticleEmitter gives emitters created from
+	// now on
+	for (auto iPool = pools.begin(); iPool != pools.end(); ++iPool)
+	{
+		for (auto iEmitter = iPool->emitters.begin(); iEmitter != iPool->emitters.end(); ++iEmitter)
+		{
+			iEmitter->emitRate = iEmitter->emitRate * shardCount / count;
+			iEmitter->counter = (float)index / count;
+		}
+	}
+
+	shardIndex = index;
+	shardCount = count;
+	return true;
+}
+
+uint32_t ParticleSystem::Subscribe(const std::wstring & particleTexture, const EventHandler & handler)
+{
+	auto iter = poolMap.find(particleTexture);
+	if (iter == poolMap.end() || 0 == pools[iter->second].eventCapacity)
+		return 0;
+
+	Subscription subscription;
+	subscription.id = nextSubscriptionId++;
+	subscription.pool = iter->second;
+	subscription.handler = handler;
+	subscriptions.push_back(subscription);
+
+	return subscription.id;
+}
+
+void ParticleSystem::Unsubscribe(uint32_t id)
+{
+	for (auto iSub = subscriptions.begin(); iSub != subscriptions.end(); ++iSub)
+	{
+		if (iSub->id == id)
+		{
+			subscriptions.erase(iSub);
+			return;
+		}
+	}
+}
+
+void ParticleSystem::StageEvents(ParticlePool & pool)
+{
+	if (0 == (pool.features & PARTICLE_FEATURE_EVENTS))
+		return;
+
+	// every slot still waiting on the GPU: this frame's events are lost
+	if (pool.eventsInFlight == PARTICLE_EVENT_READBACK_FRAMES)
+	{
+		pool.stats.eventFramesSkipped++;
+		return;
+	}
+
+	uint32_t slot = (pool.eventHead + pool.eventsInFlight) % PARTICLE_EVENT_READBACK_FRAMES;
+	context->CopyResource(pool.bufEventStaging[slot], pool.bufEvents);
+	context->CopyResource(pool.bufEventCountStaging[slot], pool.bufEventCount);
+	pool.eventsInFlight++;
+}
+
+void ParticleSystem::ReadBackEvents(ParticlePool & pool, uint32_t firstChunk)
+{
+	while (pool.eventsInFlight > 0)
+	{
+		uint32_t slot = pool.eventHead;
+
+		// the count is copied after the events, so once it has landed the
+		// events have too
+		D3D11_MAPPED_SUBRESOURCE mapped = {};
+		if (S_OK != context->Map(pool.bufEventCountStaging[slot], 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped))
+			return;
+
+		uint32_t count = *reinterpret_cast<const uint32_t*>(mapped.pData);
+		context->Unmap(pool.bufEventCountStaging[slot], 0);
+
+		if (count > pool.eventCapacity)
+		{
+			pool.stats.eventsDropped += count - pool.eventCapacity;
+			count = pool.eventCapacity;
+		}
+
+		if (count > 0)
+		{
+			HRESULT hr = context->Map(pool.bufEventStaging[slot], 0, D3D11_MAP_READ, 0, &mapped);
+			assert(hr == S_OK);
+
+			// slots are reported across the whole pool, not per chunk
+			const ParticleEvent* events = reinterpret_cast<const ParticleEvent*>(mapped.pData);
+			eventScratch.assign(events, events + count);
+			context->Unmap(pool.bufEventStaging[slot], 0);
+
+			for (auto iEvent = eventScratch.begin(); iEvent != eventScratch.end(); ++iEvent)
+				iEvent->particle += pool.chunkBase;
+
+			DeliverEvents(firstChunk, eventScratch.data(), count);
+		}
+
+		pool.eventHead = (pool.eventHead + 1) % PARTICLE_EVENT_READBACK_FRAMES;
+		pool.eventsInFlight--;
+	}
+}
+
+void ParticleSystem::DeliverEvents(uint32_t firstChunk, const ParticleEvent * events, uint32_t count)
+{
+	for (auto iSub = subscriptions.begin(); iSub != subscriptions.end(); ++iSub)
+	{
+		if (iSub->pool == firstChunk)
+			iSub->handler(events, count);
+	}
+}
+
+bool ParticleSystem::PostEvents(const std::wstring & particleTexture, const ParticleEvent * events, uint32_t count)
+{
+	auto iter = poolMap.find(particleTexture);
+	if (iter == poolMap.end() || 0 == pools[iter->second].eventCapacity)
+		return false;
+
+	ParticlePool& pool = pools[iter->second];
+	uint32_t room = pool.eventCapacity - min((uint32_t)pool.hostEvents.size(), pool.eventCapacity);
+	if (count > room)
+	{
+		pool.stats.eventsDropped += count - room;
+		count = room;
+	}
+
+	pool.hostEvents.insert(pool.hostEvents.end(), events, events + count);
+	return true;
+}
+
+bool ParticleSystem::SetInstances(const std::wstring & particleTexture, const ParticleInstance * instances, uint32_t count)
+{
+	auto iPool = poolMap.find(particleTexture);
+	if (iPool == poolMap.end() || !pools[iPool->second].instanced || count > MAX_PARTICLE_INSTANCES)
+		return false;
+
+	// every chunk draws all the copies of its own particles
+	for (uint32_t i = 0; i < pools[iPool->second].chunkCount; ++i)
+	{
+		ParticlePool& pool = pools[iPool->second + i];
+
+		if (count > 0)
+		{
+			D3D11_MAPPED_SUBRESOURCE mapped = {};
+			HRESULT hr = context->Map(pool.bufInstances, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+			assert(hr == S_OK);
+
+			memcpy(mapped.pData, instances, count * sizeof(ParticleInstance));
+			context->Unmap(pool.bufInstances, 0);
+		}
+
+		pool.instanceCount = count;
+
+		uint32_t indexCount = DrawIndexCount(pool);
+		uint32_t offset = (iPool->second + i) * PARTICLE_DRAW_ARGS_STRIDE;
+		D3D11_BOX box = { offset, 0, 0, offset + (uint32_t)sizeof(uint32_t), 1, 1 };
+		context->UpdateSubresource(bufIndirectDrawArgs, 0, &box, &indexCount, 0, 0);
+	}
+
+	return true;
+}
+
+bool ParticleSystem::StartRecording(const std::wstring & particleTexture, const std::wstring & fileName, const ParticleRecorderDesc & desc)
+{
+	auto iPool = poolMap.find(particleTexture);
+	if (iPool == poolMap.end())
+		return false;
+
+	for (auto iRec = recordings.begin(); iRec != recordings.end(); ++iRec)
+	{
+		if (iRec->pool == iPool->second)
+			return false;
+	}
+
+	Recording recording = {};
+	recording.pool = iPool->second;
+	recording.lossless = desc.lossless;
+
+	uint32_t chunkCount = pools[recording.pool].chunkCount;
+	uint32_t particleCount = 0;
+	for (uint32_t i = 0; i < chunkCount; ++i)
+		particleCount += pools[recording.pool + i].particleConstants.maxParticles;
+
+	recording.recorder = new ParticleRecorder();
+	if (!recording.recorder->Open(fileName, particleCount, desc))
+	{
+		delete recording.recorder;
+		return false;
+	}
+
+	for (uint32_t slot = 0; slot < PARTICLE_EVENT_READBACK_FRAMES; ++slot)
+	{
+		for (uint32_t i = 0; i < chunkCount; ++i)
+		{
+			CD3D11_BUFFER_DESC stagingDesc(
+				pools[recording.pool + i].particleConstants.maxParticles * sizeof(Particle),
+				0,
+				D3D11_USAGE_STAGING,
+				D3D11_CPU_ACCESS_READ
+			);
+
+			ID3D11Buffer* staging = nullptr;
+			HRESULT hr = device->CreateBuffer(&stagingDesc, nullptr, &staging);
+			assert(hr == S_OK);
+			recording.staging.push_back(staging);
+		}
+	}
+
+	recordings.push_back(recording);
+	return true;
+}
+
+bool ParticleSystem::StopRecording(const std::wstring & particleTexture, ParticleRecorderStats * stats)
+{
+	auto iPool = poolMap.find(particleTexture);
+	if (iPool == poolMap.end())
+		return false;
+
+	for (uint32_t i = 0; i < recordings.size(); ++i)
+	{
+		if (recordings[i].pool != iPool->second)
+			continue;
+
+		// readbacks still in flight only reach the file if it's lossless
+		while (recordings[i].lossless && LandRecordedFrame(i, true))
+			;
+		recordings[i].recorder->Close();
+		if (nullptr != stats)
+			*stats = recordings[i].recorder->GetStats();
+
+		EndRecording(i);
+		return true;
+	}
+
+	return false;
+}
+
+void ParticleSystem::EndRecording(uint32_t index)
+{
+	Recording& recording = recordings[index];
+
+	delete recording.recorder;
+	for (auto iStaging = recording.staging.begin(); iStaging != recording.staging.end(); ++iStaging)
+		(*iStaging)->Release();
+
+	recordings.erase(recordings.begin() + index);
+}
+
+void ParticleSystem::RecordFrames()
+{
+	for (uint32_t index = 0; index < recordings.size(); ++index)
+	{
+		Recording& recording = recordings[index];
+		uint32_t chunkCount = pools[recording.pool].chunkCount;
+
+		while (LandRecordedFrame(index, false))
+			;
+
+		// lossless recordings wait for the oldest readback instead
+		if (recording.lossless && recording.inFlight == PARTICLE_EVENT_READBACK_FRAMES)
+			LandRecordedFrame(index, true);
+
+		// every slot still waiting on the GPU: this frame is skipped
+		if (recording.inFlight == PARTICLE_EVENT_READBACK_FRAMES)
+		{
+			recording.recorder->Skip();
+		}
+		else
+		{
+			uint32_t slot = (recording.head + recording.inFlight) % PARTICLE_EVENT_READBACK_FRAMES;
+			for (uint32_t i = 0; i < chunkCount; ++i)
+				context->CopyResource(recording.staging[slot * chunkCount + i], pools[recording.pool + i].bufParticles);
+			recording.slotFrame[slot] = recording.frame;
+			recording.inFlight++;
+		}
+
+		recording.frame++;
+	}
+}
+
+// Hands the oldest readback of the recording to its recorder, false if
+// there is none or (unless waiting for it) it hasn't landed yet
+bool ParticleSystem::LandRecordedFrame(uint32_t index, bool wait)
+{
+	Recording& recording = recordings[index];
+	if (0 == recording.inFlight)
+		return false;
+
+	uint32_t chunkCount = pools[recording.pool].chunkCount;
+	uint32_t slot = recording.head;
+
+	// the chunks are copied in order, so once the last one has landed all
+	// of them have
+	ID3D11Buffer* last = recording.staging[slot * chunkCount + chunkCount - 1];
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (S_OK != context->Map(last, 0, D3D11_MAP_READ, wait ? 0 : D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped))
+		return false;
+	context->Unmap(last, 0);
+
+	Particle* particles = recording.recorder->Acquire(recording.slotFrame[slot]);
+	for (uint32_t i = 0; nullptr != particles && i < chunkCount; ++i)
+	{
+		ID3D11Buffer* staging = recording.staging[slot * chunkCount + i];
+		const ParticlePool& pool = pools[recording.pool + i];
+
+		HRESULT hr = context->Map(staging, 0, D3D11_MAP_READ, 0, &mapped);
+		assert(hr == S_OK);
+
+		memcpy(particles + pool.chunkBase, mapped.pData, pool.particleConstants.maxParticles * sizeof(Particle));
+		context->Unmap(staging, 0);
+	}
+	if (nullptr != particles)
+		recording.recorder->Submit(particles);
+
+	recording.head = (recording.head + 1) % PARTICLE_EVENT_READBACK_FRAMES;
+	recording.inFlight--;
+	return true;
+}
+
+bool ParticleSystem::CreatePlaybackPool(const std::wstring & texFileName, const std::wstring & cacheFile, const ParticlePlaybackDesc & desc)
+{
+	if (poolMap.find(texFileName) != poolMap.end())
+		return false;
+
+	Playback playback = {};
+	playback.player = new ParticlePlayer();
+	if (!playback.player->Open(cacheFile, desc.prefetchFrames, desc.hostNode))
+	{
+		delete playback.player;
+		return false;
+	}
+
+	// stateless: no dead list, no simulate pass, every slot drawn
+	ParticlePoolDesc poolDesc;
+	poolDesc.maxParticles = playback.player->GetParticleCount();
+	poolDesc.stateless = true;
+	CreateParticlePool(texFileName, poolDesc);
+
+	playback.pool = poolMap[texFileName];
+	for (uint32_t i = 0; i < pools[playback.pool].chunkCount; ++i)
+		pools[playback.pool + i].external = true;
+
+	CD3D11_BUFFER_DESC uploadDesc(
+		poolDesc.maxParticles * sizeof(Particle),
+		0,
+		D3D11_USAGE_STAGING,
+		D3D11_CPU_ACCESS_WRITE
+	);
+
+	for (uint32_t i = 0; i < PARTICLE_PLAYBACK_UPLOAD_BUFFERS; ++i)
+	{
+		HRESULT hr = device->CreateBuffer(&uploadDesc, nullptr, &playback.upload[i]);
+		assert(hr == S_OK);
+	}
+
+	playback.frameRate = desc.frameRate;
+	playback.loop = desc.loop;
+	playback.shownFrame = 0xFFFFFFFF;
+	playbacks.push_back(playback);
+
+	return true;
+}
+
+bool ParticleSystem::SetPlayhead(const std::wstring & particleTexture, float seconds)
+{
+	auto iPool = poolMap.find(particleTexture);
+	if (iPool == poolMap.end())
+		return false;
+
+	for (auto iPlayback = playbacks.begin(); iPlayback != playbacks.end(); ++iPlayback)
+	{
+		if (iPlayback->pool == iPool->second)
+		{
+			iPlayback->time = max(seconds, 0.0f);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ParticleSystem::StreamPlayback(float deltaTime)
+{
+	for (auto iPlayback = playbacks.begin(); iPlayback != playbacks.end(); ++iPlayback)
+	{
+		Playback& playback = *iPlayback;
+
+		uint32_t frameCount = playback.player->GetFrameCount();
+		float duration = frameCount / playback.frameRate;
+
+		playback.time += deltaTime;
+		if (playback.loop)
+			playback.time = fmod(playback.time, duration);
+		else
+			playback.time = min(playback.time, duration);
+
+		uint32_t frame = min(static_cast<uint32_t>(playback.time * playback.frameRate), frameCount - 1);
+		if (frame == playback.shownFrame)
+			continue;
+
+		// not decoded yet: keep showing the last frame
+		const Particle* particles = playback.player->Fetch(frame);
+		if (nullptr == particles)
+			continue;
+
+		// still being copied from: try again next frame
+		ID3D11Buffer* upload = playback.upload[playback.uploadHead];
+		D3D11_MAPPED_SUBRESOURCE mapped = {};
+		if (S_OK != context->Map(upload, 0, D3D11_MAP_WRITE, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped))
+			continue;
+
+		memcpy(mapped.pData, particles, playback.player->GetParticleCount() * sizeof(Particle));
+		context->Unmap(upload, 0);
+
+		for (uint32_t i = 0; i < pools[playback.pool].chunkCount; ++i)
+		{
+			const ParticlePool& pool = pools[playback.pool + i];
+
+			D3D11_BOX box = {
+				pool.chunkBase * (UINT)sizeof(Particle), 0, 0,
+				(pool.chunkBase + pool.particleConstants.maxParticles) * (UINT)sizeof(Particle), 1, 1
+			};
+			context->CopySubresourceRegion(pool.bufParticles, 0, 0, 0, 0, upload, 0, &box);
+		}
+
+		playback.uploadHead = (playback.uploadHead + 1) % PARTICLE_PLAYBACK_UPLOAD_BUFFERS;
+		playback.shownFrame = frame;
+	}
 }
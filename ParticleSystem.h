@@ -4,11 +4,24 @@
 #include "SimpleShader.h"
 #include "ParticlePool.h"
 #include "ParticleEmitter.h"
+#include "KernelTuner.h"
+#include "GpuTimer.h"
+#include "ParticleModuleGraph.h"
+#include "ParticleFeatures.h"
+#include "ParticleRecorder.h"
+#include "ParticlePlayer.h"
 
+#include <functional>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+// DrawIndexedInstancedIndirect args, 5 uints, padded to 16 bytes. The dead
+// count goes in the spare slots, where a graphics debugger shows it. The
+// DrawInstancedIndirect args of the other draw strategies follow
+#define PARTICLE_DRAW_ARGS_STRIDE			(sizeof(uint32_t) * 12)
+#define PARTICLE_DRAW_VERTEX_ARGS_OFFSET	(sizeof(uint32_t) * 8)
+
 class ParticleSystem
 {
 public:
@@ -17,9 +30,32 @@ public:
 		device(nullptr),
 		context(nullptr),
 		particleVS(nullptr),
+		particleExpandedVS(nullptr),
 		particlePS(nullptr),
-		particleCS(nullptr),
-		particleEmitterCS(nullptr)
+		particleCS(),
+		particleEmitterCS(),
+		particleEmitterBitsetCS(nullptr),
+		particleFusedCS(nullptr),
+		shardIndex(0),
+		shardCount(1),
+		nextSubscriptionId(1),
+		particleSortKeysCS(nullptr),
+		particleSortStepCS(nullptr),
+		particleReorderCS(nullptr),
+		particleRecycleHistogramCS(nullptr),
+		particleRecycleCollectCS(nullptr),
+		particleExpandCS(nullptr),
+		particleDrawArgsCS(nullptr),
+		bufIndirectDrawArgs(nullptr),
+		bufIndirectDrawArgsUAV(nullptr),
+		drawArgsCapacity(0),
+		screenMinPixels(0.0f),
+		screenMaxPixels(0.0f),
+		cullPlane(),
+		cullPixelScale(0.0f),
+		profiling(false),
+		profileAllFeatures(false),
+		totalTime(0.0f)
 	{}
 
 	bool Init(ID3D11Device* device, ID3D11DeviceContext* context);
@@ -32,25 +68,197 @@ public:
 
 	ParticleEmitter* CreateParticleEmitter(const std::wstring& particleTexture);
 
+	// Creates the pool used by emitters of this texture with non-default settings.
+	// Must be called before the first emitter of that texture is created
+	bool CreateParticlePool(const std::wstring& texFileName, const ParticlePoolDesc& desc);
+
+	// Creates one pool for emitters of any of these textures, packed at load
+	// into a single atlas so they all share its simulate dispatch and draw.
+	// Each texture's name then refers to this pool, and emitters created
+	// with it draw that texture, see ParticleEmitter::SetTexture. Fails if
+	// any texture already has a pool or doesn't load, or they don't fit in
+	// the largest texture D3D11 allows
+	bool CreateAtlasPool(const std::vector<std::wstring>& texFileNames, const ParticlePoolDesc& desc);
+
+	// The strategy found fastest for PARTICLE_DRAW_AUTO pools of this size,
+	// or PARTICLE_DRAW_AUTO while they are still being timed. Results are
+	// kept in ParticleDraws.cache, a line per power-of-two size
+	ParticleDrawStrategy GetFastestDrawStrategy(uint32_t maxParticles) const;
+
+	// Particles smaller than minPixels on screen are left out of the draw,
+	// and larger than maxPixels are shrunk to it (0 = no limit either way).
+	// The simulate passes cull against the camera of the previous Draw, the
+	// vertex shader against the current one, and clamps
+	void SetScreenSizeLimits(float minPixels, float maxPixels);
+
+	bool GetStats(const std::wstring& particleTexture, ParticlePoolStats& stats) const;
+
+	// Times every pool's simulate pass on the GPU while enabled, see
+	// ParticlePoolTimings. The timings land a few frames late
+	void SetProfiling(bool enabled);
+	bool GetTimings(const std::wstring& particleTexture, ParticlePoolTimings& timings) const;
+
+	// Replaces the behavior modules run on every particle of the pool.
+	// Fails if there is no such pool or the graph is too big to compile
+	bool SetModules(const std::wstring& particleTexture, const ParticleModuleGraph& graph);
+
+	// Makes this system simulate shard `index` of `count` of the effect, for
+	// bakes split across processes. Every emitter runs at 1/count of its
+	// rate, phase-shifted by index/count of a spawn, so the shards together
+	// spawn on exactly the schedule one process would. Particles don't
+	// interact, so the shards never need to exchange any; see ParticleBake.
+	// Emitters that already exist are rescaled and restart their phase.
+	// Fails unless index < count
+	bool SetShard(uint32_t index, uint32_t count);
+
+	// Called from Update with a batch of a pool's events, a few frames after
+	// they happened. The pointer is only valid during the call, and the
+	// handler must not subscribe or unsubscribe
+	typedef std::function<void(const ParticleEvent* events, uint32_t count)> EventHandler;
+
+	// Returns an id for Unsubscribe, or 0 if there is no such pool or it was
+	// created without an eventCapacity
+	uint32_t Subscribe(const std::wstring& particleTexture, const EventHandler& handler);
+	void Unsubscribe(uint32_t id);
+
+	// Queues events of a host-side simulation of the pool, see
+	// HostSimulateParams, for its subscribers. They arrive in a batch of
+	// their own at the next Update, and past the pool's eventCapacity per
+	// Update count as dropped. Fails like Subscribe
+	bool PostEvents(const std::wstring& particleTexture, const ParticleEvent* events, uint32_t count);
+
+	// Replaces the copies an instanced pool draws. Fails if there is no such
+	// pool, it wasn't created instanced, or count > MAX_PARTICLE_INSTANCES
+	bool SetInstances(const std::wstring& particleTexture, const ParticleInstance* instances, uint32_t count);
+
+	// Writes every pool's particles, allocator state and emitters to a file,
+	// see ParticleSnapshot.h. Reads the GPU buffers back, so it stalls
+	bool SaveSnapshot(const std::wstring& fileName);
+
+	// Puts the pools back the way a snapshot found them. The same pools and
+	// emitters must have been created first, in the same order and with the
+	// same settings; if they don't match, nothing is changed and it fails.
+	// Instances and module programs are not part of a snapshot
+	bool LoadSnapshot(const std::wstring& fileName);
+
+	// Records the pool's particles every frame to a file, see
+	// ParticleRecorder.h. Frames are read back a few frames late and
+	// encoded on a thread of their own; frames that would have to wait for
+	// either are skipped. Fails if there is no such pool or it's already
+	// being recorded
+	bool StartRecording(const std::wstring& particleTexture, const std::wstring& fileName, const ParticleRecorderDesc& desc);
+
+	// Waits for the queued frames to be written
+	bool StopRecording(const std::wstring& particleTexture, ParticleRecorderStats* stats = nullptr);
+
+	// Creates a pool that plays back a recording made with StartRecording
+	// instead of simulating, drawn like any other. The recorded emitter ids
+	// index the pool's emitters: create that many with CreateParticleEmitter
+	// and set their appearance, they never spawn anything. Frames that are
+	// not decoded in time are shown late rather than waited for
+	bool CreatePlaybackPool(const std::wstring& texFileName, const std::wstring& cacheFile, const ParticlePlaybackDesc& desc);
+
+	// Scrubs a playback pool to this many seconds into its recording
+	bool SetPlayhead(const std::wstring& particleTexture, float seconds);
+
+	// Creates a pool holding every point of a point file, see
+	// ParticlePointCloud.h, as particles that never die and are never
+	// simulated, only drawn. The file is streamed into the pool in batches
+	// straight from its mapping. Fails if an emitter id is MAX_EMITTERS or
+	// more. Like playback pools, the ids index the pool's emitters: create
+	// one with CreateParticleEmitter for every id up to the highest the
+	// file uses and set their appearance, or those points have none
+	bool LoadPointCloud(const std::wstring& texFileName, const std::wstring& pointFile);
+
 private:
 	friend class ParticleEmitter;
 
-	bool CreateParticlePool(uint32_t maxParticles, const std::wstring& texFileName);
+	// What a profiled simulate pass is timed as, see ParticlePoolTimings
+	enum ProfileKind
+	{
+		PROFILE_SIMULATE,
+		PROFILE_BEFORE_REORDER,
+		PROFILE_AFTER_REORDER,
+		PROFILE_ALL_FEATURES,
+		PROFILE_KIND_COUNT
+	};
+
+	// frames on either side of a Morton sort timed as before and after it
+	static const uint32_t PROFILE_REORDER_FRAMES = 8;
+
+	void EmitParticles(ParticlePool& pool, float totalTime);
+	void SimulateParticles(ParticlePool& pool, float deltaTime, float totalTime);
+	void SimulateFused(ParticlePool& pool, float deltaTime, float totalTime);
+	void ReadBackStats(ParticlePool& pool);
+	void ReserveRings(ParticlePool& pool);
+	void PickRecycleVictims(ParticlePool& pool, uint32_t victimCount);
+	void ReorderParticles(ParticlePool& pool);
+	void CreatePoolChunks(const std::wstring& name, ID3D11ShaderResourceView* texSRV, const ParticlePoolDesc& desc);
+	void CreatePoolChunk(ParticlePool& pool, const ParticlePoolDesc& desc);
+	void ReserveDrawArgs();
+	void WriteDrawArgs();
+	void SetCullConstants(SimpleComputeShader* cs, const ParticlePool& pool);
+	void BindQuadResources(ISimpleShader* shader, const ParticlePool& pool, ParticleDrawStrategy strategy);
+	void ExpandParticles(ParticlePool& pool, uint32_t argsOffset);
+	void BindModules(SimpleComputeShader* cs, const ParticlePool& pool);
+	void ReadBackEvents(ParticlePool& pool, uint32_t firstChunk);
+	void DeliverEvents(uint32_t firstChunk, const ParticleEvent* events, uint32_t count);
+	void StageEvents(ParticlePool& pool);
+	void UploadEmitterParams(ParticlePool& pool);
+	void RecordFrames();
+	bool LandRecordedFrame(uint32_t index, bool wait);
+	void EndRecording(uint32_t index);
+	void StreamPlayback(float deltaTime);
+	void CreateCounterBuffer(uint32_t count, ID3D11Buffer** buffer, ID3D11UnorderedAccessView** uav);
+	void BeginProfile(const ParticlePool& pool, ProfileKind kind);
+	ProfileKind ReorderProfileKind(const ParticlePool& pool) const;
+	void ApplyTimings();
 
 private:
 	ID3D11Device*					device;
 	ID3D11DeviceContext*			context;
 
 	SimpleVertexShader*				particleVS;
+	SimpleVertexShader*				particleExpandedVS;
 	SimplePixelShader*				particlePS;
 	SimpleComputeShader*			particleInitCS;
-	SimpleComputeShader*			particleEmitterCS;
-	SimpleComputeShader*			particleCS;
+	SimpleComputeShader*			particleEmitterCS[KERNEL_VARIANT_COUNT];
+	SimpleComputeShader*			particleEmitterBitsetCS;
+	SimpleComputeShader*			particleFusedCS;
+	SimpleComputeShader*			particleSortKeysCS;
+	SimpleComputeShader*			particleSortStepCS;
+	SimpleComputeShader*			particleReorderCS;
+	SimpleComputeShader*			particleRecycleHistogramCS;
+	SimpleComputeShader*			particleRecycleCollectCS;
+	SimpleComputeShader*			particleExpandCS;
+	SimpleComputeShader*			particleDrawArgsCS;
+	SimpleComputeShader*			particleCS[PARTICLE_FEATURE_MASKS][KERNEL_VARIANT_COUNT];
 
-	ID3D11Buffer*					bufEmitter;
+	KernelTuner						tuner;
+	KernelTuner						drawTuner;		// brackets Draw rather than Update
+
+	GpuTimer						profiler;
+	bool							profiling;
+	bool							profileAllFeatures;	// this frame runs the unspecialized simulate kernel
+	std::vector<GpuTiming>			landedTimings;
+
+	ID3D11Buffer*					bufEmitter[KERNEL_VARIANT_COUNT];
+	ID3D11Buffer*					bufDispatchCounters;		// scratch counters, cleared before each dispatch that uses them
+	ID3D11UnorderedAccessView*		bufDispatchCountersUAV;
+	ID3D11Buffer*					bufRecycleCounters;		// see ParticleRecycle.h, cleared per pool and frame
+	ID3D11UnorderedAccessView*		bufRecycleCountersUAV;
+	ID3D11Buffer*					bufEmitterSpawns;
+	ID3D11ShaderResourceView*		bufEmitterSpawnsSRV;
 
 	ID3D11Buffer*					bufQuadIndices;
-	ID3D11Buffer*					bufIndirectDrawArgs;
+	ID3D11Buffer*					bufIndirectDrawArgs;	// a region of PARTICLE_DRAW_ARGS_STRIDE per pool chunk
+	ID3D11UnorderedAccessView*		bufIndirectDrawArgsUAV;	// raw
+	uint32_t						drawArgsCapacity;		// chunks bufIndirectDrawArgs has room for
+
+	float							screenMinPixels;
+	float							screenMaxPixels;
+	DirectX::XMFLOAT4				cullPlane;			// view depth of the camera Draw was last given
+	float							cullPixelScale;		// pixels per world size over depth, same camera; 0 before the first Draw
 
 	ID3D11SamplerState*				sampler;
 	ID3D11BlendState*				blendState;
@@ -58,8 +266,49 @@ private:
 
 	typedef std::unordered_map<std::wstring, uint32_t> map_t;
 	map_t							poolMap;
+	map_t							atlasTextures;		// index of each texture packed into an atlas pool
 
 	std::vector<ParticlePool>		pools;
 
 	uint32_t						totalEmitCount;
+	float							totalTime;			// as of the last Update, for stateless pools
+
+	uint32_t						shardIndex;
+	uint32_t						shardCount;
+
+	struct Subscription
+	{
+		uint32_t					id;
+		uint32_t					pool;	// first chunk
+		EventHandler				handler;
+	};
+	std::vector<Subscription>		subscriptions;
+	uint32_t						nextSubscriptionId;
+	std::vector<ParticleEvent>		eventScratch;
+
+	struct Recording
+	{
+		uint32_t					pool;		// first chunk
+		ParticleRecorder*			recorder;
+		std::vector<ID3D11Buffer*>	staging;	// PARTICLE_EVENT_READBACK_FRAMES slots of one buffer per chunk
+		uint32_t					head;		// oldest slot still in flight
+		uint32_t					inFlight;
+		uint32_t					frame;		// frames since the recording started
+		uint32_t					slotFrame[PARTICLE_EVENT_READBACK_FRAMES];
+		bool						lossless;	// see ParticleRecorderDesc
+	};
+	std::vector<Recording>			recordings;
+
+	struct Playback
+	{
+		uint32_t					pool;		// first chunk
+		ParticlePlayer*				player;
+		ID3D11Buffer*				upload[PARTICLE_PLAYBACK_UPLOAD_BUFFERS];
+		uint32_t					uploadHead;
+		float						time;
+		float						frameRate;
+		bool						loop;
+		uint32_t					shownFrame;	// last frame copied into the pool
+	};
+	std::vector<Playback>			playbacks;
 };
\ No newline at end of file
@@ -1,41 +1,15 @@
-struct Particle
-{
-	float4 position;  // w = age
-	float4 velocity;  // w = life time;
-};
-
-StructuredBuffer<Particle> particles : register(t0);
-
-StructuredBuffer<uint> drawList : register(t1);
-
-
-cbuffer CameraConstants : register(b0)
-{
-	matrix view;
-	matrix projection;
-};
-
-struct V2F
-{
-	float4 position : SV_POSITION;
-	float2 texcoord : TEXCOORD0;
-};
+#include "ParticleQuad.hlsli"
 
 V2F main(uint vid : SV_VertexID, uint iid : SV_InstanceID)
 {
-	V2F output;
-
-	uint pid = drawList[iid];
-	float4 pos = particles[pid].position;
-	pos.w = 1;
-
-	pos = mul(pos, view);
-
-	float2 uv = float2(vid % 2, vid / 2);
-	pos.xy += (uv - 0.5) * 1;
-
-	output.position = mul(pos, projection);
-	output.texcoord = uv;
+	// six vertices per copy, the copies of a particle next to each other
+	if (vertexIds)
+	{
+		uint copies = max(instanceCount, 1);
+		uint quad = vid / 6;
+		return ParticleCorner(quad / copies, quad % copies, QUAD_CORNERS[vid % 6]);
+	}
 
-	return output;
+	// an instance per particle, four vertex ids per copy, see bufQuadIndices
+	return ParticleCorner(iid, vid / 4, vid % 4);
 }
\ No newline at end of file
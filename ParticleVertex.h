@@ -0,0 +1,15 @@
+#ifndef _PARTICLE_VERTEX_
+#define _PARTICLE_VERTEX_
+
+#include "ShaderCommon.h"
+
+// A corner of a particle's quad as ParticleExpandCS writes it, ready for
+// the rasterizer. Six per particle, the two triangles of QUAD_CORNERS
+struct ParticleVertex
+{
+	float4		position;	// clip space
+	float4		color;
+	float2		texcoord;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,21 @@
+#ifndef _PARTICLE_VICTIMS_
+#define _PARTICLE_VICTIMS_
+
+#include "Emitter.h"
+#include "ParticleParams.hlsli"
+
+// OVERFLOW_STEAL: rank of every emitter's priority within the pool, 0 for
+// the lowest, see ParticleSystem::EmitParticles
+StructuredBuffer<uint> emitterRanks : register(t4);
+
+// Histogram bucket of a live particle when picking overflow victims: how
+// much of its life it has used for OVERFLOW_RECYCLE, the rank of its
+// emitter for OVERFLOW_STEAL
+uint VictimBucket(Particle p, uint overflowPolicy)
+{
+	if (overflowPolicy == OVERFLOW_STEAL)
+		return min(emitterRanks[p.emitter], RECYCLE_BUCKETS - 1);
+	return RecycleBucket(p);
+}
+
+#endif
\ No newline at end of file
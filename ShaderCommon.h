@@ -9,6 +9,7 @@
 typedef DirectX::XMFLOAT2	float2;
 typedef DirectX::XMFLOAT3	float3;
 typedef DirectX::XMFLOAT4	float4;
+typedef DirectX::XMFLOAT4X4	float4x4;
 typedef uint32_t			uint;
 typedef DirectX::XMUINT2	uint2;
 typedef DirectX::XMUINT3	uint3;
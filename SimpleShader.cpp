@@ -1,5 +1,7 @@
 #include "SimpleShader.h"
 
+#include <cassert>
+
 ///////////////////////////////////////////////////////////////////////////////
 // ------ BASE SIMPLE SHADER --------------------------------------------------
 ///////////////////////////////////////////////////////////////////////////////
@@ -1617,13 +1619,22 @@ void SimpleComputeShader::DispatchByGroups(unsigned int groupsX, unsigned int gr
 // threadsX - Desired numbers of threads in the X dimension
 // threadsY - Desired numbers of threads in the Y dimension
 // threadsZ - Desired numbers of threads in the Z dimension
+//
+// Group counts are computed in integers (a float ceil
+// rounds wrong past 2^24 threads) and must each stay
+// within D3D11_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION
 // --------------------------------------------------------
 void SimpleComputeShader::DispatchByThreads(unsigned int threadsX, unsigned int threadsY, unsigned int threadsZ)
 {
-	deviceContext->Dispatch(
-		max((unsigned int)ceil((float)threadsX / this->threadsX), 1),
-		max((unsigned int)ceil((float)threadsY / this->threadsY), 1),
-		max((unsigned int)ceil((float)threadsZ / this->threadsZ), 1));
+	unsigned int groupsX = max(threadsX / this->threadsX + (threadsX % this->threadsX != 0), 1u);
+	unsigned int groupsY = max(threadsY / this->threadsY + (threadsY % this->threadsY != 0), 1u);
+	unsigned int groupsZ = max(threadsZ / this->threadsZ + (threadsZ % this->threadsZ != 0), 1u);
+
+	assert(groupsX <= D3D11_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION);
+	assert(groupsY <= D3D11_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION);
+	assert(groupsZ <= D3D11_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION);
+
+	deviceContext->Dispatch(groupsX, groupsY, groupsZ);
 }
 
 // --------------------------------------------------------